@@ -29,6 +29,7 @@
 #include <graphene/chain/db_with.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/protocol/fee_schedule.hpp>
+#include <graphene/protocol/public_key_cache.hpp>
 #include <graphene/protocol/types.hpp>
 
 #include <graphene/egenesis/egenesis.hpp>
@@ -52,6 +53,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include <iostream>
+#include <sstream>
 
 #include <fc/log/file_appender.hpp>
 #include <fc/log/logger.hpp>
@@ -112,6 +114,7 @@ namespace detail {
 }}
 
 #include "application_impl.hxx"
+#include "database_api_impl.hxx"
 
 namespace graphene { namespace app { namespace detail {
 
@@ -349,6 +352,9 @@ void application_impl::set_api_limit() {
    if(_options->count("api-limit-list-htlcs")){
       _app_options.api_limit_list_htlcs = _options->at("api-limit-list-htlcs").as<uint64_t>();
    }
+   if(_options->count("api-worker-threads")){
+      _app_options.api_worker_threads = _options->at("api-worker-threads").as<uint16_t>();
+   }
 }
 
 void application_impl::startup()
@@ -423,11 +429,47 @@ void application_impl::startup()
    }
    _chain_db->add_checkpoints( loaded_checkpoints );
 
+   if( _options->count("replay-state-hash") && !_options->count("replay-blockchain")
+         && !_options->count("revalidate-blockchain") )
+      wlog( "Ignoring replay-state-hash, it only applies together with replay-blockchain or revalidate-blockchain" );
+   else if( _options->count("replay-state-hash") )
+   {
+      auto check = fc::json::from_string( _options->at("replay-state-hash").as<string>() )
+                      .as<std::pair<uint32_t,fc::sha256> >( 2 );
+      _chain_db->set_replay_state_check( check.first, check.second );
+   }
+
+   if( _options->count("track-state-hash") && _options->at("track-state-hash").as<bool>() )
+      _chain_db->enable_state_hash_tracking();
+
    if( _options->count("enable-standby-votes-tracking") )
    {
       _chain_db->enable_standby_votes_tracking( _options->at("enable-standby-votes-tracking").as<bool>() );
    }
 
+   if( _options->count("incremental-db-flush") )
+   {
+      _chain_db->set_incremental_flush( _options->at("incremental-db-flush").as<bool>(),
+                                        _options->at("db-flush-compaction-interval").as<uint32_t>() );
+   }
+
+   if( _options->count("public-key-cache-size") )
+      graphene::protocol::public_key_cache::set_capacity( _options->at("public-key-cache-size").as<uint32_t>() );
+   if( _options->count("transaction-signature-cache-size") )
+      graphene::protocol::public_key_cache::set_transaction_capacity(
+            _options->at("transaction-signature-cache-size").as<uint32_t>() );
+
+   if( _options->count("api-max-read-time") )
+      _chain_db->set_max_read_time( fc::milliseconds( _options->at("api-max-read-time").as<uint32_t>() ) );
+
+   if( _options->count("reindex-memory-budget") )
+      _chain_db->set_reindex_memory_budget( uint64_t( _options->at("reindex-memory-budget").as<uint32_t>() ) << 20 );
+
+   if( _options->count("block-log-compression") )
+      _chain_db->set_block_log_compression( _options->at("block-log-compression").as<uint32_t>() );
+   if( _options->count("block-log-retain-blocks") )
+      _chain_db->set_block_log_pruning( _options->at("block-log-retain-blocks").as<uint32_t>() );
+
    if( _options->count("replay-blockchain") || _options->count("revalidate-blockchain") )
       _chain_db->wipe( _data_dir / "blockchain", false );
 
@@ -503,11 +545,52 @@ void application_impl::startup()
       _apiaccess.permission_map["*"] = wild_access;
    }
 
+   // prefetch_sync_block() runs on the p2p thread, set up what it reads before the thread starts
+   _sync_prefetch_chain_id = _chain_db->get_chain_id();
+   if( _options->count("sync-prefetch-blocks") )
+      _sync_prefetch_limit = _options->at("sync-prefetch-blocks").as<uint32_t>();
    reset_p2p_node(_data_dir);
    reset_websocket_server();
    reset_websocket_tls_server();
+
+   if( _options->count("memory-usage-log-interval") )
+      _memory_usage_log_interval = _options->at("memory-usage-log-interval").as<uint32_t>();
+   if( _memory_usage_log_interval > 0 )
+      _chain_db->update_memory_usage();
+   schedule_memory_usage_log();
 } FC_LOG_AND_RETHROW() }
 
+void application_impl::schedule_memory_usage_log()
+{
+   if( _memory_usage_log_interval == 0 )
+      return;
+   _memory_usage_log_task = fc::schedule( [this]() {
+      log_memory_usage();
+      schedule_memory_usage_log();
+   }, fc::time_point::now() + fc::seconds( _memory_usage_log_interval ), "log memory usage" );
+}
+
+void application_impl::log_memory_usage()const
+{ try {
+   auto usage = _chain_db->update_memory_usage();
+   uint64_t total = 0;
+   for( const auto& item : usage )
+      total += item.fixed_bytes + item.member_bytes + item.secondary_bytes;
+   std::sort( usage.begin(), usage.end(), []( const graphene::db::index_memory_usage& a,
+                                              const graphene::db::index_memory_usage& b ) {
+      return a.fixed_bytes + a.member_bytes + a.secondary_bytes > b.fixed_bytes + b.member_bytes + b.secondary_bytes;
+   });
+
+   const uint64_t mib = 1024 * 1024;
+   std::stringstream largest;
+   for( size_t i = 0; i < usage.size() && i < 5; ++i )
+      largest << " " << uint32_t(usage[i].space_id) << "." << uint32_t(usage[i].type_id) << ": "
+              << usage[i].object_count << " objects " << usage[i].fixed_bytes / mib << "+"
+              << usage[i].member_bytes / mib << "+" << usage[i].secondary_bytes / mib << " MiB;";
+   ilog( "Estimated object database memory usage ${t} MiB, largest indexes:${l}",
+         ("t", total / mib)("l", largest.str()) );
+} FC_CAPTURE_AND_LOG( (0) ) }
+
 optional< api_access_info > application_impl::get_api_access_info(const string& username)const
 {
    optional< api_access_info > result;
@@ -621,6 +704,33 @@ bool application_impl::handle_block(const graphene::net::block_message& blk_msg,
    }
 } FC_CAPTURE_AND_RETHROW( (blk_msg)(sync_mode) ) return false; }
 
+void application_impl::prefetch_sync_block(const graphene::net::block_message& blk_msg)
+{
+   while( !_sync_prefetch_tasks.empty() && _sync_prefetch_tasks.front().ready() )
+      _sync_prefetch_tasks.pop_front();
+   // never block the p2p thread, if enough blocks are in flight the block is recovered by handle_block()
+   if( _sync_prefetch_tasks.size() >= _sync_prefetch_limit )
+      return;
+
+   // transaction signatures are only checked during sync by block producers or with --force-validate
+   const bool recover_transactions = _is_block_producer || _force_validate;
+   auto block = std::make_shared<signed_block>( blk_msg.block );
+   const chain_id_type chain_id = _sync_prefetch_chain_id;
+   _sync_prefetch_tasks.push_back( fc::do_parallel( [block,chain_id,recover_transactions] () {
+      try
+      {
+         block->signee();
+         if( recover_transactions )
+            for( const auto& trx : block->transactions )
+               trx.get_signature_keys( chain_id );
+      }
+      catch( const fc::exception& )
+      {
+         // invalid signatures are reported when the block is applied
+      }
+   }, "prefetch_sync_block" ) );
+}
+
 void application_impl::handle_transaction(const graphene::net::trx_message& transaction_message)
 { try {
    static fc::time_point last_call;
@@ -695,6 +805,11 @@ std::vector<item_hash_t> application_impl::get_block_ids(const std::vector<item_
        FC_THROW_EXCEPTION( graphene::net::peer_is_on_an_unreachable_fork,
                            "Unable to provide a list of blocks starting at any of the blocks in peer's synopsis" );
    }
+   // the peer would ask us for blocks we no longer have
+   if( block_header::num_from_id(last_known_block_id) + 1 < _chain_db->get_first_stored_block_num() )
+      FC_THROW_EXCEPTION( graphene::net::peer_is_on_an_unreachable_fork,
+                          "Blocks before ${first} have been pruned, unable to provide the blocks following the peer's synopsis",
+                          ("first", _chain_db->get_first_stored_block_num()) );
    for( uint32_t num = block_header::num_from_id(last_known_block_id);
         num <= _chain_db->head_block_num() && result.size() < limit;
         ++num )
@@ -716,7 +831,9 @@ message application_impl::get_item(const item_id& id)
    if( id.item_type == graphene::net::block_message_type )
    {
       auto opt_block = _chain_db->fetch_block_by_id(id.item_hash);
-      if( !opt_block )
+      if( !opt_block && block_header::num_from_id(id.item_hash) < _chain_db->get_first_stored_block_num() )
+         elog("Couldn't find block ${id} -- it has been pruned", ("id", id.item_hash));
+      else if( !opt_block )
          elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
               ("id", id.item_hash)("id2", _chain_db->get_block_id_for_num(block_header::num_from_id(id.item_hash))));
       FC_ASSERT( opt_block.valid() );
@@ -999,6 +1116,12 @@ void application::set_program_options(boost::program_options::options_descriptio
           "JSON array of P2P nodes to connect to on startup")
          ("checkpoint,c", bpo::value<vector<string>>()->composing(),
           "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
+         ("replay-state-hash", bpo::value<string>(),
+          "Pair of [BLOCK_NUM,STATE_HASH], replaying fails unless the state hash after BLOCK_NUM matches. "
+          "Only used together with replay-blockchain or revalidate-blockchain. Blocks up to the last checkpoint are replayed without undo history.")
+         ("track-state-hash", bpo::value<bool>()->default_value(false),
+          "Maintain hash trees over the chain state so that the get_state_hash API call answers cheaply. "
+          "Costs a hash per object change, including while replaying")
          ("rpc-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8090"),
           "Endpoint for websocket RPC to listen on")
          ("rpc-tls-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8089"),
@@ -1014,6 +1137,28 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("enable-standby-votes-tracking", bpo::value<bool>()->implicit_value(true),
           "Whether to enable tracking of votes of standby witnesses and committee members. "
           "Set it to true to provide accurate data to API clients, set to false for slightly better performance.")
+         ("reindex-memory-budget", bpo::value<uint32_t>()->default_value(1024),
+          "Memory in MiB the blocks read ahead while replaying may use, the read ahead is sized automatically "
+          "within this limit")
+         ("public-key-cache-size", bpo::value<uint32_t>()->default_value(200000),
+          "Number of recovered signature public keys to cache, 0 disables the cache")
+         ("transaction-signature-cache-size", bpo::value<uint32_t>()->default_value(50000),
+          "Number of transactions whose recovered signature public keys are cached, so that transactions "
+          "already checked in the mempool are not checked again when they arrive in a block, 0 disables the cache")
+         ("sync-prefetch-blocks", bpo::value<uint32_t>()->default_value(64),
+          "Maximum number of blocks whose signatures are recovered in the background while syncing, "
+          "0 disables the prefetch")
+         ("block-log-compression", bpo::value<uint32_t>(),
+          "Store blocks in zlib compressed frames of this many blocks, 0 stores them uncompressed. "
+          "Only applies when the block log is created, i.e. on a new node or with --resync-blockchain")
+         ("block-log-retain-blocks", bpo::value<uint32_t>(),
+          "Prune blocks older than this many blocks from the block log, 0 keeps all blocks. At least 10000 blocks "
+          "are kept; at 3 seconds per block 28800 blocks cover one day. A pruned node can not replay, it has to resync")
+         ("incremental-db-flush", bpo::value<bool>()->implicit_value(true),
+          "Whether to save only the objects changed since the last save when writing the object database to disk, "
+          "instead of rewriting it completely every time")
+         ("db-flush-compaction-interval", bpo::value<uint32_t>()->default_value(100),
+          "Number of incremental object database saves after which the complete state is rewritten")
          ("api-limit-get-account-history-operations",boost::program_options::value<uint64_t>()->default_value(100),
           "For history_api::get_account_history_operations to set its default limit value as 100")
          ("api-limit-get-account-history",boost::program_options::value<uint64_t>()->default_value(100),
@@ -1044,6 +1189,16 @@ void application::set_program_options(boost::program_options::options_descriptio
           "For database_api_impl::get_limit_orders to set its default limit value as 300")
          ("api-limit-get-order-book",boost::program_options::value<uint64_t>()->default_value(50),
           "For database_api_impl::get_order_book to set its default limit value as 50")
+         ("api-worker-threads",boost::program_options::value<uint16_t>()->default_value(0),
+          "Number of threads that run read-only database API queries in parallel with each other, 0 to run them "
+          "on the main thread. Block and transaction processing waits for running queries, see api-max-read-time")
+         ("api-max-read-time",boost::program_options::value<uint32_t>()->default_value(250),
+          "Milliseconds block processing waits for a database API query on a worker thread before the query "
+          "is aborted, 0 to let queries finish. Only queries that iterate over many objects can be aborted, the "
+          "others always finish first")
+         ("memory-usage-log-interval",boost::program_options::value<uint32_t>()->default_value(3600),
+          "Seconds between log lines reporting the estimated memory usage of the largest object indexes, "
+          "which also refresh the figures returned by get_index_memory_usage, 0 to disable both")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
@@ -1155,8 +1310,17 @@ void application::shutdown_plugins()
 }
 void application::shutdown()
 {
+   if( my->_memory_usage_log_task.valid() && !my->_memory_usage_log_task.ready() )
+   {
+      try {
+         my->_memory_usage_log_task.cancel_and_wait( "application shutdown" );
+      } catch( const fc::exception& e ) {
+         wlog( "Exception while stopping the memory usage log: ${e}", ("e", e.to_detail_string()) );
+      }
+   }
    if( my->_p2p_network )
       my->_p2p_network->close();
+   detail::stop_api_worker_threads();
    if( my->_chain_db )
    {
       my->_chain_db->close();
@@ -3,6 +3,8 @@
 #include <fc/network/http/websocket.hpp>
 #include <fc/thread/parallel.hpp>
 
+#include <deque>
+
 #include <graphene/app/application.hpp>
 #include <graphene/app/api_access.hpp>
 #include <graphene/chain/genesis_state.hpp>
@@ -38,6 +40,8 @@ class application_impl : public net::node_delegate
 
       virtual ~application_impl()
       {
+         for( auto& task : _sync_prefetch_tasks )
+            task.wait();
       }
 
       void set_dbg_init_key( graphene::chain::genesis_state_type& genesis, const std::string& init_key );
@@ -45,6 +49,9 @@ class application_impl : public net::node_delegate
 
       void startup();
 
+      void schedule_memory_usage_log();
+      void log_memory_usage()const;
+
       fc::optional< api_access_info > get_api_access_info(const string& username)const;
 
       void set_api_access_info(const string& username, api_access_info&& permissions);
@@ -65,6 +72,12 @@ class application_impl : public net::node_delegate
       virtual bool handle_block(const graphene::net::block_message& blk_msg, bool sync_mode,
                                 std::vector<fc::uint160_t>& contained_transaction_message_ids) override;
 
+      /**
+       * @brief recovers the signing keys of a sync block in the background, so that handle_block()
+       * finds them in the public key cache
+       */
+      virtual void prefetch_sync_block(const graphene::net::block_message& blk_msg) override;
+
       virtual void handle_transaction(const graphene::net::trx_message& transaction_message) override;
 
       void handle_message(const graphene::net::message& message_to_process) override;
@@ -197,6 +210,14 @@ class application_impl : public net::node_delegate
       std::map<string, std::shared_ptr<abstract_plugin>> _available_plugins;
 
       bool _is_finished_syncing = false;
+
+      uint32_t         _memory_usage_log_interval = 0;
+      fc::future<void> _memory_usage_log_task;
+
+      uint32_t                       _sync_prefetch_limit = 64;
+      /** only touched by prefetch_sync_block() on the p2p thread once the node runs */
+      std::deque<fc::future<void>>   _sync_prefetch_tasks;
+      graphene::chain::chain_id_type _sync_prefetch_chain_id;
    private:
       fc::serial_valve valve;
    };
@@ -35,9 +35,44 @@
 #include <boost/range/iterator_range.hpp>
 
 #include <cctype>
+#include <mutex>
 
 template class fc::api<graphene::app::database_api>;
 
+namespace graphene { namespace app { namespace detail {
+
+namespace {
+   std::mutex                                   api_workers_mutex;
+   std::vector< std::unique_ptr<fc::thread> >   api_workers;
+   bool                                         api_workers_stopped = false;
+   uint32_t                                     next_api_worker = 0;
+}
+
+void run_on_api_worker( uint16_t num_threads, const std::function<void()>& task )
+{
+   fc::future<void> done;
+   {
+      std::lock_guard<std::mutex> lock( api_workers_mutex );
+      FC_ASSERT( !api_workers_stopped, "The API worker threads have been stopped" );
+      for( uint16_t i = api_workers.size(); i < num_threads; ++i )
+         api_workers.emplace_back( new fc::thread( "api worker " + fc::to_string( i ) ) );
+      // post while holding the lock, so that stop_api_worker_threads() cancels the task instead of losing it
+      done = api_workers[ next_api_worker++ % api_workers.size() ]->async( task, "database_api read query" );
+   }
+   done.wait();
+}
+
+void stop_api_worker_threads()
+{
+   std::lock_guard<std::mutex> lock( api_workers_mutex );
+   api_workers_stopped = true;
+   for( auto& worker : api_workers )
+      worker->quit();
+   api_workers.clear();
+}
+
+} } } // graphene::app::detail
+
 namespace graphene { namespace app {
 
 //////////////////////////////////////////////////////////////////////
@@ -318,6 +353,33 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
    return _db.get(dynamic_global_property_id_type());
 }
 
+vector<index_memory_usage> database_api::get_index_memory_usage()const
+{
+   return my->get_index_memory_usage();
+}
+
+vector<index_memory_usage> database_api_impl::get_index_memory_usage()const
+{
+   return _db.get_last_memory_usage();
+}
+
+fc::sha256 database_api::get_state_hash( optional<uint8_t> space_id, optional<uint8_t> type_id )const
+{
+   return my->run_read_query( [&]() { return my->get_state_hash( space_id, type_id ); } );
+}
+
+fc::sha256 database_api_impl::get_state_hash( optional<uint8_t> space_id, optional<uint8_t> type_id )const
+{
+   FC_ASSERT( _db.is_state_hash_tracked(), "State hash tracking is not enabled on this node" );
+   if( !space_id.valid() )
+   {
+      FC_ASSERT( !type_id.valid(), "type_id requires space_id" );
+      return _db.get_state_hash();
+   }
+   FC_ASSERT( type_id.valid(), "type_id is required with space_id" );
+   return _db.get_index_state_hash( *space_id, *type_id );
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Keys                                                             //
@@ -326,7 +388,7 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
 
 vector<flat_set<account_id_type>> database_api::get_key_references( vector<public_key_type> key )const
 {
-   return my->get_key_references( key );
+   return my->run_read_query( [&]() { return my->get_key_references( key ); } );
 }
 
 /**
@@ -345,6 +407,7 @@ vector<flat_set<account_id_type>> database_api_impl::get_key_references( vector<
 
    for( auto& key : keys )
    {
+      _db.check_read_time();
       address a1( pts_address(key, false, 56) );
       address a2( pts_address(key, true, 56) );
       address a3( pts_address(key, false, 0)  );
@@ -453,7 +516,7 @@ std::map<std::string, full_account> database_api_impl::get_full_accounts( const
 {
    FC_ASSERT( names_or_ids.size() <= _app_options->api_limit_get_full_accounts );
 
-   const auto& proposal_idx = _db.get_index_type< primary_index< proposal_index > >();
+   const auto& proposal_idx = _db.get_index_type< primary_index< proposal_index, hashed_ids > >();
    const auto& proposals_by_account = proposal_idx.get_secondary_index<graphene::chain::required_approval_index>();
 
    bool to_subscribe = get_whether_to_subscribe( subscribe );
@@ -516,7 +579,7 @@ std::map<std::string, full_account> database_api_impl::get_full_accounts( const
             acnt.more_data_available.balances = true;
             break;
          }
-         acnt.balances.emplace_back(*balance.second);
+         acnt.balances.emplace_back(*balance.object);
       }
 
       // Add the account's vesting balances
@@ -635,7 +698,7 @@ optional<account_object> database_api_impl::get_account_by_name( string name )co
 
 vector<account_id_type> database_api::get_account_references( const std::string account_id_or_name )const
 {
-   return my->get_account_references( account_id_or_name );
+   return my->run_read_query( [&]() { return my->get_account_references( account_id_or_name ); } );
 }
 
 vector<account_id_type> database_api_impl::get_account_references( const std::string account_id_or_name )const
@@ -650,7 +713,11 @@ vector<account_id_type> database_api_impl::get_account_references( const std::st
    if( itr != refs.account_to_account_memberships.end() )
    {
       result.reserve( itr->second.size() );
-      for( auto item : itr->second ) result.push_back(item);
+      for( auto item : itr->second )
+      {
+         _db.check_read_time();
+         result.push_back(item);
+      }
    }
    return result;
 }
@@ -723,7 +790,7 @@ uint64_t database_api_impl::get_account_count()const
 vector<asset> database_api::get_account_balances( const std::string& account_name_or_id,
                                                   const flat_set<asset_id_type>& assets )const
 {
-   return my->get_account_balances( account_name_or_id, assets );
+   return my->run_read_query( [&]() { return my->get_account_balances( account_name_or_id, assets ); } );
 }
 
 vector<asset> database_api_impl::get_account_balances( const std::string& account_name_or_id,
@@ -739,7 +806,7 @@ vector<asset> database_api_impl::get_account_balances( const std::string& accoun
       const auto& balances = balance_index.get_secondary_index< balances_by_account_index >()
                                           .get_account_balances( acnt );
       for( const auto balance : balances )
-         result.push_back( balance.second->get_balance() );
+         result.push_back( asset( balance.balance, balance.asset_type ) );
    }
    else
    {
@@ -755,12 +822,12 @@ vector<asset> database_api_impl::get_account_balances( const std::string& accoun
 vector<asset> database_api::get_named_account_balances( const std::string& name,
                                                         const flat_set<asset_id_type>& assets )const
 {
-   return my->get_account_balances( name, assets );
+   return my->run_read_query( [&]() { return my->get_account_balances( name, assets ); } );
 }
 
 vector<balance_object> database_api::get_balance_objects( const vector<address>& addrs )const
 {
-   return my->get_balance_objects( addrs );
+   return my->run_read_query( [&]() { return my->get_balance_objects( addrs ); } );
 }
 
 vector<balance_object> database_api_impl::get_balance_objects( const vector<address>& addrs )const
@@ -777,6 +844,7 @@ vector<balance_object> database_api_impl::get_balance_objects( const vector<addr
          auto itr = by_owner_idx.lower_bound( boost::make_tuple( owner, asset_id_type(0) ) );
          while( itr != by_owner_idx.end() && itr->owner == owner )
          {
+            _db.check_read_time();
             result.push_back( *itr );
             ++itr;
          }
@@ -806,7 +874,7 @@ vector<asset> database_api_impl::get_vested_balances( const vector<balance_id_ty
 
 vector<vesting_balance_object> database_api::get_vesting_balances( const std::string account_id_or_name )const
 {
-   return my->get_vesting_balances( account_id_or_name );
+   return my->run_read_query( [&]() { return my->get_vesting_balances( account_id_or_name ); } );
 }
 
 vector<vesting_balance_object> database_api_impl::get_vesting_balances( const std::string account_id_or_name )const
@@ -818,7 +886,8 @@ vector<vesting_balance_object> database_api_impl::get_vesting_balances( const st
       auto vesting_range = _db.get_index_type<vesting_balance_index>().indices().get<by_account>()
                               .equal_range(account_id);
       std::for_each(vesting_range.first, vesting_range.second,
-                    [&result](const vesting_balance_object& balance) {
+                    [this,&result](const vesting_balance_object& balance) {
+                       _db.check_read_time();
                        result.emplace_back(balance);
                     });
       return result;
@@ -865,7 +934,7 @@ vector<optional<extended_asset_object>> database_api_impl::get_assets(
 
 vector<extended_asset_object> database_api::list_assets(const string& lower_bound_symbol, uint32_t limit)const
 {
-   return my->list_assets( lower_bound_symbol, limit );
+   return my->run_read_query( [&]() { return my->list_assets( lower_bound_symbol, limit ); } );
 }
 
 vector<extended_asset_object> database_api_impl::list_assets(const string& lower_bound_symbol, uint32_t limit)const
@@ -901,7 +970,7 @@ uint64_t database_api_impl::get_asset_count()const
 vector<extended_asset_object> database_api::get_assets_by_issuer(const std::string& issuer_name_or_id,
                                                                  asset_id_type start, uint32_t limit)const
 {
-   return my->get_assets_by_issuer(issuer_name_or_id, start, limit);
+   return my->run_read_query( [&]() { return my->get_assets_by_issuer(issuer_name_or_id, start, limit); } );
 }
 
 vector<extended_asset_object> database_api_impl::get_assets_by_issuer(const std::string& issuer_name_or_id,
@@ -956,7 +1025,7 @@ vector<optional<extended_asset_object>> database_api_impl::lookup_asset_symbols(
 
 vector<limit_order_object> database_api::get_limit_orders(std::string a, std::string b, uint32_t limit)const
 {
-   return my->get_limit_orders( a, b, limit );
+   return my->run_read_query( [&]() { return my->get_limit_orders( a, b, limit ); } );
 }
 
 vector<limit_order_object> database_api_impl::get_limit_orders( const std::string& a, const std::string& b,
@@ -1061,7 +1130,7 @@ vector<limit_order_object> database_api_impl::get_account_limit_orders(
 
 vector<call_order_object> database_api::get_call_orders(const std::string& a, uint32_t limit)const
 {
-   return my->get_call_orders( a, limit );
+   return my->run_read_query( [&]() { return my->get_call_orders( a, limit ); } );
 }
 
 vector<call_order_object> database_api_impl::get_call_orders(const std::string& a, uint32_t limit)const
@@ -1087,7 +1156,7 @@ vector<call_order_object> database_api_impl::get_call_orders(const std::string&
 vector<call_order_object> database_api::get_call_orders_by_account(const std::string& account_name_or_id,
                                                                    asset_id_type start, uint32_t limit)const
 {
-   return my->get_call_orders_by_account( account_name_or_id, start, limit );
+   return my->run_read_query( [&]() { return my->get_call_orders_by_account( account_name_or_id, start, limit ); } );
 }
 
 vector<call_order_object> database_api_impl::get_call_orders_by_account(const std::string& account_name_or_id,
@@ -1111,7 +1180,7 @@ vector<call_order_object> database_api_impl::get_call_orders_by_account(const st
 
 vector<force_settlement_object> database_api::get_settle_orders(const std::string& a, uint32_t limit)const
 {
-   return my->get_settle_orders( a, limit );
+   return my->run_read_query( [&]() { return my->get_settle_orders( a, limit ); } );
 }
 
 vector<force_settlement_object> database_api_impl::get_settle_orders(const std::string& a, uint32_t limit)const
@@ -1139,7 +1208,7 @@ vector<force_settlement_object> database_api::get_settle_orders_by_account(
       force_settlement_id_type start,
       uint32_t limit )const
 {
-   return my->get_settle_orders_by_account( account_name_or_id, start, limit);
+   return my->run_read_query( [&]() { return my->get_settle_orders_by_account( account_name_or_id, start, limit); } );
 }
 
 vector<force_settlement_object> database_api_impl::get_settle_orders_by_account(
@@ -1166,7 +1235,7 @@ vector<force_settlement_object> database_api_impl::get_settle_orders_by_account(
 
 vector<call_order_object> database_api::get_margin_positions( const std::string account_id_or_name )const
 {
-   return my->get_margin_positions( account_id_or_name );
+   return my->run_read_query( [&]() { return my->get_margin_positions( account_id_or_name ); } );
 }
 
 vector<call_order_object> database_api_impl::get_margin_positions( const std::string account_id_or_name )const
@@ -1181,6 +1250,7 @@ vector<call_order_object> database_api_impl::get_margin_positions( const std::st
       vector<call_order_object> result;
       while( start != end )
       {
+         _db.check_read_time();
          result.push_back(*start);
          ++start;
       }
@@ -1191,7 +1261,7 @@ vector<call_order_object> database_api_impl::get_margin_positions( const std::st
 vector<collateral_bid_object> database_api::get_collateral_bids( const std::string& asset,
                                                                  uint32_t limit, uint32_t start )const
 {
-   return my->get_collateral_bids( asset, limit, start );
+   return my->run_read_query( [&]() { return my->get_collateral_bids( asset, limit, start ); } );
 }
 
 vector<collateral_bid_object> database_api_impl::get_collateral_bids( const std::string& asset,
@@ -1308,7 +1378,7 @@ market_volume database_api_impl::get_24_volume( const string& base, const string
 
 order_book database_api::get_order_book( const string& base, const string& quote, unsigned limit )const
 {
-   return my->get_order_book( base, quote, limit);
+   return my->run_read_query( [&]() { return my->get_order_book( base, quote, limit); } );
 }
 
 order_book database_api_impl::get_order_book( const string& base, const string& quote, unsigned limit )const
@@ -1357,7 +1427,7 @@ order_book database_api_impl::get_order_book( const string& base, const string&
 
 vector<market_ticker> database_api::get_top_markets(uint32_t limit)const
 {
-   return my->get_top_markets(limit);
+   return my->run_read_query( [&]() { return my->get_top_markets(limit); } );
 }
 
 vector<market_ticker> database_api_impl::get_top_markets(uint32_t limit)const
@@ -1374,6 +1444,7 @@ vector<market_ticker> database_api_impl::get_top_markets(uint32_t limit)const
 
    while( itr != volume_idx.rend() && result.size() < limit)
    {
+      _db.check_read_time();
       const asset_object base = itr->base(_db);
       const asset_object quote = itr->quote(_db);
       order_book orders;
@@ -1391,7 +1462,7 @@ vector<market_trade> database_api::get_trade_history( const string& base,
                                                       fc::time_point_sec stop,
                                                       unsigned limit )const
 {
-   return my->get_trade_history( base, quote, start, stop, limit );
+   return my->run_read_query( [&]() { return my->get_trade_history( base, quote, start, stop, limit ); } );
 }
 
 vector<market_trade> database_api_impl::get_trade_history( const string& base,
@@ -1424,6 +1495,7 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
    while( itr != history_idx.end() && count < limit
           && !( itr->key.base != base_id || itr->key.quote != quote_id || itr->time < stop ) )
    {
+      _db.check_read_time();
       {
          market_trade trade;
 
@@ -1482,7 +1554,7 @@ vector<market_trade> database_api::get_trade_history_by_sequence(
                                                       fc::time_point_sec stop,
                                                       unsigned limit )const
 {
-   return my->get_trade_history_by_sequence( base, quote, start, stop, limit );
+   return my->run_read_query( [&]() { return my->get_trade_history_by_sequence( base, quote, start, stop, limit ); } );
 }
 
 vector<market_trade> database_api_impl::get_trade_history_by_sequence(
@@ -1519,6 +1591,7 @@ vector<market_trade> database_api_impl::get_trade_history_by_sequence(
    while( itr != history_idx.end() && count < limit
           && !( itr->key.base != base_id || itr->key.quote != quote_id || itr->time < stop ) )
    {
+      _db.check_read_time();
       if( itr->key.sequence == start_seq ) // found the key, should skip this and the other direction if found
       {
          auto next_itr = std::next(itr);
@@ -1750,7 +1823,7 @@ uint64_t database_api_impl::get_committee_count()const
 
 vector<worker_object> database_api::get_all_workers()const
 {
-    return my->get_all_workers();
+    return my->run_read_query( [&]() { return my->get_all_workers(); } );
 }
 
 vector<worker_object> database_api_impl::get_all_workers()const
@@ -1759,6 +1832,7 @@ vector<worker_object> database_api_impl::get_all_workers()const
     const auto& workers_idx = _db.get_index_type<worker_index>().indices().get<by_id>();
     for( const auto& w : workers_idx )
     {
+       _db.check_read_time();
        result.push_back( w );
     }
     return result;
@@ -1766,7 +1840,7 @@ vector<worker_object> database_api_impl::get_all_workers()const
 
 vector<optional<worker_object>> database_api::get_workers_by_account(const std::string account_id_or_name)const
 {
-    return my->get_workers_by_account( account_id_or_name );
+    return my->run_read_query( [&]() { return my->get_workers_by_account( account_id_or_name ); } );
 }
 
 vector<optional<worker_object>> database_api_impl::get_workers_by_account(const std::string account_id_or_name)const
@@ -1777,6 +1851,7 @@ vector<optional<worker_object>> database_api_impl::get_workers_by_account(const
    const account_id_type account = get_account_from_string(account_id_or_name)->id;
    for( const auto& w : workers_idx )
     {
+        _db.check_read_time();
         if( w.worker_account == account )
             result.push_back( w );
     }
@@ -2135,12 +2210,12 @@ vector< fc::variant > database_api_impl::get_required_fees( const vector<operati
 
 vector<proposal_object> database_api::get_proposed_transactions( const std::string account_id_or_name )const
 {
-   return my->get_proposed_transactions( account_id_or_name );
+   return my->run_read_query( [&]() { return my->get_proposed_transactions( account_id_or_name ); } );
 }
 
 vector<proposal_object> database_api_impl::get_proposed_transactions( const std::string account_id_or_name )const
 {
-   const auto& proposal_idx = _db.get_index_type< primary_index< proposal_index > >();
+   const auto& proposal_idx = _db.get_index_type< primary_index< proposal_index, hashed_ids > >();
    const auto& proposals_by_account = proposal_idx.get_secondary_index<graphene::chain::required_approval_index>();
 
    vector<proposal_object> result;
@@ -2152,6 +2227,7 @@ vector<proposal_object> database_api_impl::get_proposed_transactions( const std:
       result.reserve( required_approvals_itr->second.size() );
       for( auto proposal_id : required_approvals_itr->second )
       {
+         _db.check_read_time();
          result.push_back( proposal_id(_db) );
       }
    }
@@ -2196,7 +2272,7 @@ vector<withdraw_permission_object> database_api::get_withdraw_permissions_by_giv
                                       withdraw_permission_id_type start,
                                       uint32_t limit)const
 {
-   return my->get_withdraw_permissions_by_giver( account_id_or_name, start, limit );
+   return my->run_read_query( [&]() { return my->get_withdraw_permissions_by_giver( account_id_or_name, start, limit ); } );
 }
 
 vector<withdraw_permission_object> database_api_impl::get_withdraw_permissions_by_giver(
@@ -2225,7 +2301,7 @@ vector<withdraw_permission_object> database_api::get_withdraw_permissions_by_rec
                                       withdraw_permission_id_type start,
                                       uint32_t limit)const
 {
-   return my->get_withdraw_permissions_by_recipient( account_id_or_name, start, limit );
+   return my->run_read_query( [&]() { return my->get_withdraw_permissions_by_recipient( account_id_or_name, start, limit ); } );
 }
 
 vector<withdraw_permission_object> database_api_impl::get_withdraw_permissions_by_recipient(
@@ -2272,7 +2348,7 @@ fc::optional<htlc_object> database_api_impl::get_htlc( htlc_id_type id, optional
 vector<htlc_object> database_api::get_htlc_by_from( const std::string account_id_or_name,
                                                     htlc_id_type start, uint32_t limit )const
 {
-   return my->get_htlc_by_from(account_id_or_name, start, limit);
+   return my->run_read_query( [&]() { return my->get_htlc_by_from(account_id_or_name, start, limit); } );
 }
 
 vector<htlc_object> database_api_impl::get_htlc_by_from( const std::string account_id_or_name,
@@ -2297,7 +2373,7 @@ vector<htlc_object> database_api_impl::get_htlc_by_from( const std::string accou
 vector<htlc_object> database_api::get_htlc_by_to( const std::string account_id_or_name,
                                                   htlc_id_type start, uint32_t limit )const
 {
-   return my->get_htlc_by_to(account_id_or_name, start, limit);
+   return my->run_read_query( [&]() { return my->get_htlc_by_to(account_id_or_name, start, limit); } );
 }
 
 vector<htlc_object> database_api_impl::get_htlc_by_to( const std::string account_id_or_name,
@@ -2322,7 +2398,7 @@ vector<htlc_object> database_api_impl::get_htlc_by_to( const std::string account
 
 vector<htlc_object> database_api::list_htlcs(const htlc_id_type start, uint32_t limit)const
 {
-   return my->list_htlcs(start, limit);
+   return my->run_read_query( [&]() { return my->list_htlcs(start, limit); } );
 }
 
 vector<htlc_object> database_api_impl::list_htlcs(const htlc_id_type start, uint32_t limit) const
@@ -2412,29 +2488,23 @@ vector<limit_order_object> database_api_impl::get_limit_orders( const asset_id_t
    uint64_t api_limit_get_limit_orders=_app_options->api_limit_get_limit_orders;
    FC_ASSERT( limit <= api_limit_get_limit_orders );
 
-   const auto& limit_order_idx = _db.get_index_type<limit_order_index>();
-   const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
+   const auto& order_books = _db.get_index_type< primary_index< limit_order_index, hashed_ids > >()
+                                .get_secondary_index< limit_order_book_index >();
 
    vector<limit_order_object> result;
    result.reserve(limit*2);
 
-   uint32_t count = 0;
-   auto limit_itr = limit_price_idx.lower_bound(price::max(a,b));
-   auto limit_end = limit_price_idx.upper_bound(price::min(a,b));
-   while(limit_itr != limit_end && count < limit)
-   {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
-   count = 0;
-   limit_itr = limit_price_idx.lower_bound(price::max(b,a));
-   limit_end = limit_price_idx.upper_bound(price::min(b,a));
-   while(limit_itr != limit_end && count < limit)
+   for( const auto& side : { order_books.find_book( a, b ), order_books.find_book( b, a ) } )
    {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
+      if( side == nullptr )
+         continue;
+      uint32_t count = 0;
+      // levels are sorted from the worst to the best price
+      for( auto level = side->rbegin(); level != side->rend() && count < limit; ++level )
+      {
+         for( auto order = level->orders.begin(); order != level->orders.end() && count < limit; ++order, ++count )
+            result.push_back( **order );
+      }
    }
 
    return result;
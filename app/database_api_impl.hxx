@@ -25,11 +25,21 @@
 #include <graphene/app/database_api.hpp>
 
 #include <fc/bloom_filter.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <functional>
 
 #define GET_REQUIRED_FEES_MAX_RECURSION 4
 
 namespace graphene { namespace app {
 
+namespace detail {
+   /** Runs task on one of the num_threads threads that run read-only queries, they are created on first use */
+   void run_on_api_worker( uint16_t num_threads, const std::function<void()>& task );
+   /** Quits and joins the API worker threads, queries started afterwards fail */
+   void stop_api_worker_threads();
+}
+
 typedef std::map< std::pair<graphene::chain::asset_id_type, graphene::chain::asset_id_type>,
                   std::vector<fc::variant> > market_queue_type;
 
@@ -61,6 +71,8 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       fc::variant_object get_config()const;
       chain_id_type get_chain_id()const;
       dynamic_global_property_object get_dynamic_global_properties()const;
+      vector<index_memory_usage> get_index_memory_usage()const;
+      fc::sha256 get_state_hash( optional<uint8_t> space_id, optional<uint8_t> type_id )const;
 
       // Keys
       vector<flat_set<account_id_type>> get_key_references( vector<public_key_type> key )const;
@@ -286,6 +298,27 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
          return _subscribe_filter.contains( key.data(), key.size() );
       }
 
+      /**
+       * Runs a read-only query on an API worker thread, holding the read side of the database's reader-writer
+       * lock. Queries run in parallel with each other, but not with modifications of the database: block and
+       * transaction processing on the main thread, which also serves the p2p network, waits until all running
+       * queries are done. Queries whose loops call check_read_time() are aborted once it has waited for the
+       * configured maximum read time, other queries hold it up until they finish. Without configured worker
+       * threads the query runs inline. The query must not touch subscription state.
+       */
+      template<typename Query>
+      auto run_read_query( Query&& query )const -> decltype( query() )
+      {
+         if( _app_options == nullptr || _app_options->api_worker_threads == 0 )
+            return query();
+         optional< decltype( query() ) > result;
+         detail::run_on_api_worker( _app_options->api_worker_threads, [this,&query,&result]() {
+            auto snapshot = _db.start_read_snapshot();
+            result = query();
+         } );
+         return std::move( *result );
+      }
+
       // for full-account subscription
       bool is_impacted_account( const flat_set<account_id_type>& accounts );
 
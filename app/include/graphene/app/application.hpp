@@ -56,6 +56,7 @@ namespace graphene { namespace app {
          uint64_t api_limit_get_limit_orders = 300;
          uint64_t api_limit_get_order_book = 50;
          uint64_t api_limit_list_htlcs = 100;
+         uint16_t api_worker_threads = 0;
    };
 
    class application
@@ -217,6 +217,27 @@ class database_api
        */
       dynamic_global_property_object get_dynamic_global_properties()const;
 
+      /**
+       * @brief Get the estimated memory footprint of every object index of this node
+       * @return per index the object count and the estimated heap bytes of the fixed-size part of the objects,
+       * of the memory owned by their members (estimated from a sample) and of the secondary indexes
+       *
+       * The figures are refreshed every memory-usage-log-interval seconds, the result is empty if that
+       * option is 0.
+       */
+      vector<index_memory_usage> get_index_memory_usage()const;
+
+      /**
+       * @brief Get the hash of the chain state, nodes which applied the same blocks return the same hash
+       * @param space_id space of a single index to get the hash of, omit to get the root over all state indexes
+       * @param type_id type of that index, required if space_id is given
+       * @return the root hash over all state indexes, or the hash of the given index
+       *
+       * Only available on nodes started with track-state-hash.
+       */
+      fc::sha256 get_state_hash( optional<uint8_t> space_id = optional<uint8_t>(),
+                                 optional<uint8_t> type_id = optional<uint8_t>() )const;
+
       //////////
       // Keys //
       //////////
@@ -919,6 +940,8 @@ FC_API(graphene::app::database_api,
    (get_config)
    (get_chain_id)
    (get_dynamic_global_properties)
+   (get_index_memory_usage)
+   (get_state_hash)
 
    // Keys
    (get_key_references)
@@ -26,6 +26,7 @@
 
 #include <fc/io/raw.hpp>
 #include <fc/uint128.hpp>
+#include <algorithm>
 
 namespace graphene { namespace chain {
 
@@ -160,6 +161,77 @@ void account_member_index::object_inserted(const object& obj)
        account_to_address_memberships[item].insert(obj.id);
 }
 
+namespace {
+   /** groups (member, account) pairs by member, the accounts of a member stay in the order they were added */
+   template<typename Member, typename Compare, typename Map>
+   void insert_memberships( vector< std::pair<Member, account_id_type> >& pairs, const Compare& less, Map& memberships )
+   {
+      std::stable_sort( pairs.begin(), pairs.end(), [&less]( const std::pair<Member, account_id_type>& a,
+                                                             const std::pair<Member, account_id_type>& b ) {
+         return less( a.first, b.first );
+      });
+      for( auto itr = pairs.begin(); itr != pairs.end(); )
+      {
+         auto& accounts = memberships[itr->first];
+         const auto& member = itr->first;
+         for( ; itr != pairs.end() && !less( member, itr->first ); ++itr )
+            accounts.insert( accounts.end(), itr->second );
+      }
+   }
+
+   /** size of a red-black tree node holding value_type, including color, parent and child links */
+   template<typename Container>
+   uint64_t tree_node_size()
+   {
+      return sizeof( typename Container::value_type ) + 4 * sizeof(void*);
+   }
+
+   template<typename Map>
+   uint64_t memberships_memory_usage( const Map& memberships )
+   {
+      typedef typename Map::mapped_type accounts_type;
+      uint64_t result = memberships.size() * tree_node_size<Map>();
+      for( const auto& item : memberships )
+         result += item.second.size() * tree_node_size<accounts_type>();
+      return result;
+   }
+}
+
+void account_member_index::objects_inserted( const vector<const object*>& objs )
+{
+   vector< std::pair<account_id_type, account_id_type> > account_pairs;
+   vector< std::pair<public_key_type, account_id_type> > key_pairs;
+   vector< std::pair<address, account_id_type> >         address_pairs;
+   for( const object* obj : objs )
+   {
+      assert( dynamic_cast<const account_object*>(obj) ); // for debug only
+      const account_object& a = static_cast<const account_object&>(*obj);
+      for( const auto& item : get_account_members(a) )
+         account_pairs.emplace_back( item, a.get_id() );
+      for( const auto& item : get_key_members(a) )
+         key_pairs.emplace_back( item, a.get_id() );
+      for( const auto& item : get_address_members(a) )
+         address_pairs.emplace_back( item, a.get_id() );
+   }
+   insert_memberships( account_pairs, std::less<account_id_type>(), account_to_account_memberships );
+   insert_memberships( key_pairs, pubkey_comparator(), account_to_key_memberships );
+   insert_memberships( address_pairs, std::less<address>(), account_to_address_memberships );
+}
+
+void account_member_index::clear()
+{
+   account_to_account_memberships.clear();
+   account_to_key_memberships.clear();
+   account_to_address_memberships.clear();
+}
+
+uint64_t account_member_index::get_memory_usage()const
+{
+   return memberships_memory_usage( account_to_account_memberships )
+        + memberships_memory_usage( account_to_key_memberships )
+        + memberships_memory_usage( account_to_address_memberships );
+}
+
 void account_member_index::object_removed(const object& obj)
 {
     assert( dynamic_cast<const account_object*>(&obj) ); // for debug only
@@ -290,6 +362,19 @@ void account_referrer_index::object_modified( const object& after  )
 const uint8_t  balances_by_account_index::bits = 20;
 const uint64_t balances_by_account_index::mask = (1ULL << balances_by_account_index::bits) - 1;
 
+balances_by_account_index::balance_row* balances_by_account_index::find_row( const account_id_type& acct )
+{
+   if( balances.size() < (acct.instance.value >> bits) + 1 ) return nullptr;
+   return &balances[acct.instance.value >> bits][acct.instance.value & mask];
+}
+
+balances_by_account_index::balance_row::iterator balances_by_account_index::find_in_row( balance_row& row,
+                                                                                       const asset_id_type& asset )const
+{
+   return std::lower_bound( row.begin(), row.end(), asset,
+                            []( const balance_entry& e, const asset_id_type& a ) { return e.asset_type < a; } );
+}
+
 void balances_by_account_index::object_inserted( const object& obj )
 {
    const auto& abo = dynamic_cast< const account_balance_object& >( obj );
@@ -299,14 +384,23 @@ void balances_by_account_index::object_inserted( const object& obj )
       balances.resize( balances.size() + 1 );
       balances.back().resize( 1ULL << bits );
    }
-   balances[abo.owner.instance.value >> bits][abo.owner.instance.value & mask][abo.asset_type] = &abo;
+   auto& row = balances[abo.owner.instance.value >> bits][abo.owner.instance.value & mask];
+   auto itr = find_in_row( row, abo.asset_type );
+   if( itr == row.end() || itr->asset_type != abo.asset_type )
+      itr = row.insert( itr, balance_entry() );
+   itr->asset_type = abo.asset_type;
+   itr->balance = abo.balance;
+   itr->object = &abo;
 }
 
 void balances_by_account_index::object_removed( const object& obj )
 {
    const auto& abo = dynamic_cast< const account_balance_object& >( obj );
-   if( balances.size() < (abo.owner.instance.value >> bits) + 1 ) return;
-   balances[abo.owner.instance.value >> bits][abo.owner.instance.value & mask].erase( abo.asset_type );
+   auto row = find_row( abo.owner );
+   if( !row ) return;
+   auto itr = find_in_row( *row, abo.asset_type );
+   if( itr != row->end() && itr->asset_type == abo.asset_type )
+      row->erase( itr );
 }
 
 void balances_by_account_index::about_to_modify( const object& before )
@@ -318,27 +412,73 @@ void balances_by_account_index::object_modified( const object& after  )
 {
    FC_ASSERT( ids_being_modified.top() == after.id, "Modification of ID is not supported!");
    ids_being_modified.pop();
+   const auto& abo = dynamic_cast< const account_balance_object& >( after );
+   auto row = find_row( abo.owner );
+   auto itr = row ? find_in_row( *row, abo.asset_type ) : balance_row::iterator();
+   FC_ASSERT( row && itr != row->end() && itr->object == &abo,
+              "Modification of balance owner or asset is not supported!" );
+   itr->balance = abo.balance;
 }
 
-const map< asset_id_type, const account_balance_object* >& balances_by_account_index::get_account_balances( const account_id_type& acct )const
+uint64_t balances_by_account_index::get_memory_usage()const
 {
-   static const map< asset_id_type, const account_balance_object* > _empty;
+   uint64_t result = balances.capacity() * sizeof( balances.front() );
+   for( const auto& chunk : balances )
+   {
+      result += chunk.capacity() * sizeof( balance_row );
+      for( const auto& row : chunk )
+         result += row.capacity() * sizeof( balance_entry );
+   }
+   return result;
+}
+
+const balances_by_account_index::balance_row& balances_by_account_index::get_account_balances(
+      const account_id_type& acct )const
+{
+   static const balance_row _empty;
 
    if( balances.size() < (acct.instance.value >> bits) + 1 ) return _empty;
    return balances[acct.instance.value >> bits][acct.instance.value & mask];
 }
 
-const account_balance_object* balances_by_account_index::get_account_balance( const account_id_type& acct, const asset_id_type& asset )const
+const balances_by_account_index::balance_entry* balances_by_account_index::find_balance( const account_id_type& acct,
+                                                                                       const asset_id_type& asset )const
 {
    if( balances.size() < (acct.instance.value >> bits) + 1 ) return nullptr;
    const auto& mine = balances[acct.instance.value >> bits][acct.instance.value & mask];
-   const auto itr = mine.find( asset );
-   if( mine.end() == itr ) return nullptr;
-   return itr->second;
+   // rows are short, a linear scan is the cheapest search
+   for( const auto& entry : mine )
+   {
+      if( entry.asset_type == asset ) return &entry;
+      if( asset < entry.asset_type ) break;
+   }
+   return nullptr;
+}
+
+const account_balance_object* balances_by_account_index::get_account_balance( const account_id_type& acct,
+                                                                             const asset_id_type& asset )const
+{
+   const auto entry = find_balance( acct, asset );
+   return entry ? entry->object : nullptr;
 }
 
 } } // graphene::chain
 
+namespace graphene { namespace db {
+
+fc::sha256 state_hash_of< graphene::chain::account_statistics_object >::hash(
+      const graphene::chain::account_statistics_object& o )
+{
+   // the history plugins maintain these, and nodes without them or with other limits have different values
+   graphene::chain::account_statistics_object consensus_part = o;
+   consensus_part.most_recent_op = graphene::chain::account_transaction_history_id_type();
+   consensus_part.total_ops = 0;
+   consensus_part.removed_ops = 0;
+   return fc::sha256::hash( consensus_part );
+}
+
+} } // graphene::db
+
 FC_REFLECT_DERIVED_NO_TYPENAME( graphene::chain::account_object,
                     (graphene::db::object),
                     (membership_expiration_date)(registrar)(referrer)(lifetime_referrer)
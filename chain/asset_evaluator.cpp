@@ -998,6 +998,16 @@ void_result asset_publish_feeds_evaluator::do_apply(const asset_publish_feed_ope
    const asset_object& base = *asset_ptr;
    const asset_bitasset_data_object& bad = *bitasset_ptr;
 
+   if( next_maint_time > HARDFORK_CORE_BATCH_FEEDS_TIME )
+   {
+      // Store the feed, the median is updated at the end of the block
+      d.modify( bad , [&o,head_time](asset_bitasset_data_object& a) {
+         a.feeds[o.publisher] = make_pair( head_time, o.feed );
+      });
+      d.defer_median_feed_update( bad );
+      return void_result();
+   }
+
    auto old_feed =  bad.current_feed;
    // Store medians for this asset
    d.modify( bad , [&o,head_time,next_maint_time](asset_bitasset_data_object& a) {
@@ -1006,39 +1016,7 @@ void_result asset_publish_feeds_evaluator::do_apply(const asset_publish_feed_ope
    });
 
    if( !(old_feed == bad.current_feed) )
-   {
-      // Check whether need to revive the asset and proceed if need
-      if( bad.has_settlement() // has globally settled, implies head_block_time > HARDFORK_CORE_216_TIME
-          && !bad.current_feed.settlement_price.is_null() ) // has a valid feed
-      {
-         bool should_revive = false;
-         const auto& mia_dyn = base.dynamic_asset_data_id(d);
-         if( mia_dyn.current_supply == 0 ) // if current supply is zero, revive the asset
-            should_revive = true;
-         else // if current supply is not zero, when collateral ratio of settlement fund is greater than MCR, revive the asset
-         {
-            if( next_maint_time <= HARDFORK_CORE_1270_TIME )
-            {
-               // before core-1270 hard fork, calculate call_price and compare to median feed
-               if( ~price::call_price( asset(mia_dyn.current_supply, o.asset_id),
-                                       asset(bad.settlement_fund, bad.options.short_backing_asset),
-                                       bad.current_feed.maintenance_collateral_ratio ) < bad.current_feed.settlement_price )
-                  should_revive = true;
-            }
-            else
-            {
-               // after core-1270 hard fork, calculate collateralization and compare to maintenance_collateralization
-               if( price( asset( bad.settlement_fund, bad.options.short_backing_asset ),
-                          asset( mia_dyn.current_supply, o.asset_id ) ) > bad.current_maintenance_collateralization )
-                  should_revive = true;
-            }
-         }
-         if( should_revive )
-            d.revive_bitasset(base);
-      }
-      // Process margin calls, allow black swan, not for a new limit order
-      d.check_call_orders( base, true, false, bitasset_ptr );
-   }
+      d.process_median_feed_change( base, bad );
 
    return void_result();
 } FC_CAPTURE_AND_RETHROW((o)) }
@@ -51,7 +51,7 @@ void graphene::chain::asset_bitasset_data_object::update_median_feeds( time_poin
    current_feed_publication_time = current_time;
    vector<std::reference_wrapper<const price_feed>> current_feeds;
    // find feeds that were alive at current_time
-   for( const pair<account_id_type, pair<time_point_sec,price_feed>>& f : feeds )
+   for( const pair<account_id_type, pair<time_point_sec,price_feed>>& f : feeds.get() )
    {
       if( (current_time - f.second.first).to_seconds() < options.feed_lifetime_sec &&
           f.second.first != time_point_sec() )
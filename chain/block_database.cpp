@@ -23,9 +23,21 @@
  */
 #include <graphene/chain/block_database.hpp>
 #include <graphene/protocol/fee_schedule.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+#include <fc/io/fstream.hpp>
 #include <fc/io/raw.hpp>
 #include <boost/endian/buffers.hpp>
 
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace graphene { namespace chain {
 
 struct index_entry
@@ -38,45 +50,560 @@ struct index_entry
    boost::endian::little_uint32_buf_t block_size;
    block_id_type                      block_id;
 };
+
+struct block_database::window
+{
+   window( const fc::path& file, uint64_t offset, size_t size )
+   :mapping( file.generic_string().c_str(), fc::read_only ),
+    region( mapping, fc::read_only, offset, size ){}
+
+   fc::file_mapping  mapping;
+   fc::mapped_region region;
+};
+
+/** one compressed frame of blocks, as stored in the frames file */
+struct block_database::frame_entry
+{
+   frame_entry() {
+      block_pos = 0;
+      file_pos = 0;
+      compressed_size = 0;
+      uncompressed_size = 0;
+   }
+   /** position of the first block of the frame in the uncompressed stream */
+   boost::endian::little_uint64_buf_t block_pos;
+   boost::endian::little_uint64_buf_t file_pos;
+   boost::endian::little_uint32_buf_t compressed_size;
+   boost::endian::little_uint32_buf_t uncompressed_size;
+};
+
+struct block_database::frame_data
+{
+   uint64_t          block_pos;
+   std::vector<char> data;
+};
  }}
 FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
 
 namespace graphene { namespace chain {
 
+block_database::block_database()
+:_index_size(0),_index_sequence(0),_blocks_size(0),_read_position(0),_tail_begin(0),_first_block(1){}
+
+block_database::~block_database()
+{
+   release_memory();
+}
+
+void block_database::set_compression( uint32_t blocks_per_frame )
+{
+   _blocks_per_frame = blocks_per_frame;
+}
+
+void block_database::set_pruning( uint32_t retain_blocks )
+{
+   _retain_blocks = retain_blocks;
+}
+
+uint32_t block_database::first_block_num()const
+{
+   return _first_block.load( std::memory_order_acquire );
+}
+
 void block_database::open( const fc::path& dbdir )
 { try {
    fc::create_directories(dbdir);
    _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
    _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
+   _dbdir = dbdir;
    _index_filename = dbdir / "index";
+   _blocks_filename = dbdir / "blocks";
    if( !fc::exists( _index_filename ) )
-   {
      _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+   else
+     _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+
+   release_memory();
+   _index_windows.reset( new std::atomic<window*>[max_index_chunks]() );
+   _windows.reset( new std::atomic<window*>[max_windows]() );
+   _read_position = 0;
+
+   // block databases created before segment files keep using their single blocks file
+   _segmented = !fc::exists( _blocks_filename ) || fc::file_size( _blocks_filename ) == 0;
+   if( _segmented )
+   {
+      if( fc::exists( _blocks_filename ) )
+         fc::remove( _blocks_filename );
+      uint64_t segment = 0;
+      while( segment < max_windows && !fc::exists( segment_filename( segment ) ) )
+         ++segment;
+      _first_segment = segment;
+      while( segment < max_windows && fc::exists( segment_filename( segment ) ) )
+         ++segment;
+      _blocks_file_size = segment > _first_segment
+                        ? ( ( segment - 1 ) << window_bits ) + fc::file_size( segment_filename( segment - 1 ) ) : 0;
    }
    else
    {
-     _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      _blocks.open( _blocks_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      _blocks_file_size = fc::file_size( _blocks_filename );
+   }
+   _blocks_size = _blocks_file_size;
+
+   _first_block_filename = dbdir / "first_block";
+   _first_block = 1;
+   if( fc::exists( _first_block_filename ) )
+   {
+      std::string first_block;
+      fc::read_file_contents( _first_block_filename, first_block );
+      _first_block = uint32_t( std::stoul( first_block ) );
+   }
+
+   _frames_filename = dbdir / "frames";
+   _compressed = fc::exists( _frames_filename ) || ( _blocks_per_frame > 0 && _blocks_size == 0 );
+   if( _compressed )
+      open_frames( dbdir );
+   else if( _blocks_per_frame > 0 )
+      wlog( "The existing block database is not compressed, it would have to be recreated to compress it" );
+
+   // the index is read through mappings of the file, see read_entry()
+   const uint64_t file_entries = fc::file_size( _index_filename ) / sizeof(index_entry);
+   FC_ASSERT( file_entries <= uint64_t(max_index_chunks) << index_chunk_bits, "Index file is too large" );
+   _index_size = uint32_t( file_entries );
+
+   // drop trailing entries that do not point to a complete block, e.g. after a crash
+   uint32_t size = _index_size;
+   while( size > 0 )
+   {
+      index_entry e;
+      read_entry( size - 1, e );
+      if( e.block_size.value() > 0 && e.block_pos.value() + e.block_size.value() <= _blocks_size )
+         try
+         {
+            if( read_block( e ).valid() )
+               break;
+         }
+         catch (const fc::exception&)
+         {
+         }
+         catch (const std::exception&)
+         {
+         }
+      --size;
+   }
+   if( size < _index_size )
+   {
+      wlog( "Dropping ${n} invalid entries from the end of the block index", ("n", _index_size - size) );
+      _index_size = size;
+      _block_num_to_pos.flush();
+      fc::resize_file( _index_filename, uint64_t(size) * sizeof(index_entry) );
    }
 } FC_CAPTURE_AND_RETHROW( (dbdir) ) }
 
 bool block_database::is_open()const
 {
-  return _blocks.is_open();
+  return _block_num_to_pos.is_open();
 }
 
 void block_database::close()
 {
-  _blocks.close();
+  if( _blocks.is_open() )
+     _blocks.close();
   _block_num_to_pos.close();
+  if( _compressed )
+  {
+     _frames_file.close();
+     _tail_file.close();
+  }
+  release_memory();
+}
+
+void block_database::release_memory()
+{
+   if( _windows )
+      for( uint32_t i = 0; i < max_windows; ++i )
+         delete _windows[i].exchange( nullptr );
+   if( _index_windows )
+      for( uint32_t i = 0; i < max_index_chunks; ++i )
+         delete _index_windows[i].exchange( nullptr );
+   _retired_windows.clear();
+   _index_size = 0;
+   _blocks_size = 0;
+
+   std::lock_guard<std::mutex> lock( _frames_mutex );
+   _frames.clear();
+   _tail.clear();
+   _frame_cache.clear();
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
+  if( _blocks.is_open() )
+     _blocks.flush();
   _block_num_to_pos.flush();
+  if( _compressed )
+  {
+     _frames_file.flush();
+     _tail_file.flush();
+  }
+}
+
+void block_database::open_frames( const fc::path& dbdir )
+{
+   _tail_filename = dbdir / "blocks.tail";
+   if( _blocks_per_frame == 0 )
+      _blocks_per_frame = default_blocks_per_frame;
+   for( auto* file : { &_frames_file, &_tail_file } )
+      file->exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   if( !fc::exists( _frames_filename ) )
+   {
+      _frames_file.open( _frames_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc );
+      _tail_file.open( _tail_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc );
+   }
+   else
+   {
+      _frames_file.open( _frames_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      if( !fc::exists( _tail_filename ) )
+         std::ofstream( _tail_filename.generic_string().c_str(), std::ofstream::binary );
+      _tail_file.open( _tail_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   }
+
+   // keep the frames which have been written completely, in order
+   const uint64_t blocks_file_size = _blocks_file_size;
+   const size_t   frame_count = fc::file_size( _frames_filename ) / sizeof(frame_entry);
+   std::vector<frame_entry> frames( frame_count );
+   _frames_file.seekg( 0 );
+   if( frame_count > 0 )
+      _frames_file.read( (char*)frames.data(), std::streamsize( frame_count * sizeof(frame_entry) ) );
+   uint64_t stream_end = 0;
+   _blocks_file_size = 0;
+   size_t valid = 0;
+   for( ; valid < frames.size(); ++valid )
+   {
+      // frames follow each other, except where one was moved to the start of the next segment
+      const frame_entry& f = frames[valid];
+      if( f.block_pos.value() != stream_end || f.file_pos.value() < _blocks_file_size
+            || f.file_pos.value() + f.compressed_size.value() > blocks_file_size )
+         break;
+      stream_end += f.uncompressed_size.value();
+      _blocks_file_size = f.file_pos.value() + f.compressed_size.value();
+   }
+   frames.resize( valid );
+   if( valid < frame_count )
+   {
+      wlog( "Dropping ${n} incomplete frames from the block database", ("n", frame_count - valid) );
+      _frames_file.flush();
+      fc::resize_file( _frames_filename, valid * sizeof(frame_entry) );
+   }
+   if( blocks_file_size > _blocks_file_size )
+      truncate_blocks( _blocks_file_size );
+
+   // the tail starts with its position in the uncompressed stream, a tail that has already been sealed into
+   // the last frame is stale
+   std::vector<char> tail;
+   boost::endian::little_uint64_buf_t tail_begin;
+   tail_begin = stream_end;
+   const uint64_t tail_file_size = fc::file_size( _tail_filename );
+   if( tail_file_size >= sizeof(tail_begin) )
+   {
+      boost::endian::little_uint64_buf_t stored;
+      _tail_file.seekg( 0 );
+      _tail_file.read( (char*)&stored, sizeof(stored) );
+      if( stored.value() == stream_end )
+      {
+         tail.resize( tail_file_size - sizeof(stored) );
+         if( !tail.empty() )
+            _tail_file.read( tail.data(), std::streamsize( tail.size() ) );
+      }
+   }
+   if( tail.empty() )
+   {
+      _tail_file.flush();
+      fc::resize_file( _tail_filename, 0 );
+      _tail_file.seekp( 0 );
+      _tail_file.write( (const char*)&tail_begin, sizeof(tail_begin) );
+      _tail_file.flush();
+   }
+
+   {
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      _frames = std::move( frames );
+      _tail = std::move( tail );
+      _tail_begin = stream_end;
+   }
+   _blocks_size = stream_end + _tail.size();
+   _tail_blocks = 0;
+}
+
+void block_database::store_compressed( const std::vector<char>& data )
+{
+   _tail_file.seekp( 0, _tail_file.end );
+   _tail_file.write( data.data(), data.size() );
+   _tail_file.flush();
+   {
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      _tail.insert( _tail.end(), data.begin(), data.end() );
+   }
+   _blocks_size.store( _blocks_size.load( std::memory_order_relaxed ) + data.size(), std::memory_order_release );
+}
+
+void block_database::seal_frame()
+{
+   std::vector<char> tail;
+   {
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      tail = _tail;
+   }
+   if( tail.empty() ) return;
+
+   uLongf compressed_size = compressBound( tail.size() );
+   std::vector<char> compressed( compressed_size );
+   FC_ASSERT( compress2( (Bytef*)compressed.data(), &compressed_size, (const Bytef*)tail.data(), tail.size(),
+                         Z_BEST_SPEED ) == Z_OK, "Failed to compress blocks" );
+
+   // the frame becomes valid once its entry is on disk, until then open() still finds the blocks in the tail
+   frame_entry f;
+   f.block_pos         = _tail_begin.load( std::memory_order_relaxed );
+   f.file_pos          = append_blocks_data( compressed.data(), compressed_size );
+   f.compressed_size   = uint32_t( compressed_size );
+   f.uncompressed_size = uint32_t( tail.size() );
+   _frames_file.seekp( 0, _frames_file.end );
+   _frames_file.write( (const char*)&f, sizeof(f) );
+   _frames_file.flush();
+
+   const uint64_t tail_begin = f.block_pos.value() + tail.size();
+   {
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      _frames.push_back( f );
+      _tail.clear();
+      _tail_begin = tail_begin;
+   }
+   boost::endian::little_uint64_buf_t header;
+   header = tail_begin;
+   fc::resize_file( _tail_filename, 0 );
+   _tail_file.seekp( 0 );
+   _tail_file.write( (const char*)&header, sizeof(header) );
+   _tail_file.flush();
+   _tail_blocks = 0;
+}
+
+bool block_database::read_entry( uint32_t block_num, index_entry& e )const
+{
+   if( block_num >= _index_size.load( std::memory_order_acquire ) )
+      return false;
+   const index_entry* chunk = map_index_chunk( block_num >> index_chunk_bits );
+   const index_entry& entry = chunk[ block_num & ( ( 1u << index_chunk_bits ) - 1 ) ];
+   while( true )
+   {
+      const uint64_t before = _index_sequence.load( std::memory_order_acquire );
+      if( before & 1 )
+         continue;
+      std::memcpy( (char*)&e, (const char*)&entry, sizeof(e) );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if( _index_sequence.load( std::memory_order_relaxed ) == before )
+         return true;
+   }
+}
+
+void block_database::write_entry( uint32_t block_num, const index_entry& e )
+{
+   // the mappings share the page cache with the file, the entry is visible to readers once it is flushed
+   _index_sequence.fetch_add( 1, std::memory_order_acq_rel );
+   _block_num_to_pos.seekp( sizeof( index_entry ) * int64_t(block_num) );
+   _block_num_to_pos.write( (const char*)&e, sizeof(e) );
+   _block_num_to_pos.flush();
+   _index_sequence.fetch_add( 1, std::memory_order_release );
+   if( block_num >= _index_size.load( std::memory_order_relaxed ) )
+      _index_size.store( block_num + 1, std::memory_order_release );
+}
+
+const index_entry* block_database::map_index_chunk( uint32_t number )const
+{
+   window* w = _index_windows[number].load( std::memory_order_acquire );
+   if( w == nullptr )
+   {
+      // like the block windows, chunks may extend past the end of the file and cover entries written later
+      const size_t chunk_size = sizeof(index_entry) << index_chunk_bits;
+      std::unique_ptr<window> created( new window( _index_filename, uint64_t(number) * chunk_size, chunk_size ) );
+      window* expected = nullptr;
+      if( _index_windows[number].compare_exchange_strong( expected, created.get(), std::memory_order_acq_rel ) )
+         w = created.release();
+      else
+         w = expected;
+   }
+   return (const index_entry*)w->region.get_address();
+}
+
+fc::path block_database::segment_filename( uint64_t number )const
+{
+   std::string name = fc::to_string( number );
+   if( name.size() < 6 )
+      name.insert( 0, 6 - name.size(), '0' );
+   return _dbdir / ( "blocks." + name );
+}
+
+uint64_t block_database::append_blocks_data( const char* data, size_t size )
+{
+   uint64_t pos = _blocks_file_size;
+   if( _segmented )
+   {
+      FC_ASSERT( size > 0 && size <= ( size_t(1) << window_bits ), "Can not store ${n} bytes in one segment", ("n", size) );
+      // data that does not fit into the current segment starts the next one
+      if( ( pos >> window_bits ) != ( ( pos + size - 1 ) >> window_bits ) )
+         pos = ( ( pos >> window_bits ) + 1 ) << window_bits;
+      const uint64_t segment = pos >> window_bits;
+      if( !_blocks.is_open() || segment != _current_segment )
+      {
+         if( _blocks.is_open() )
+            _blocks.close();
+         const fc::path file = segment_filename( segment );
+         auto mode = std::fstream::binary | std::fstream::in | std::fstream::out;
+         if( !fc::exists( file ) )
+            mode |= std::fstream::trunc;
+         _blocks.open( file.generic_string().c_str(), mode );
+         _current_segment = segment;
+      }
+      _blocks.seekp( pos - ( segment << window_bits ) );
+   }
+   else
+      _blocks.seekp( 0, _blocks.end );
+   _blocks.write( data, size );
+   // the mappings only see what has been handed to the OS
+   _blocks.flush();
+   _blocks_file_size = pos + size;
+   return pos;
+}
+
+void block_database::truncate_blocks( uint64_t end )
+{
+   if( _blocks.is_open() )
+      _blocks.flush();
+   if( _segmented && _blocks.is_open() )
+      _blocks.close();
+   if( !_segmented )
+      fc::resize_file( _blocks_filename, end );
+   else
+   {
+      const uint64_t last = end > 0 ? ( end - 1 ) >> window_bits : 0;
+      for( uint64_t segment = last + 1; segment < max_windows && fc::exists( segment_filename( segment ) ); ++segment )
+         fc::remove( segment_filename( segment ) );
+      if( fc::exists( segment_filename( last ) ) )
+         fc::resize_file( segment_filename( last ), end - ( last << window_bits ) );
+   }
+   _blocks_file_size = end;
+}
+
+const char* block_database::map_window( uint64_t number )const
+{
+   FC_ASSERT( number < max_windows, "Blocks file is too large" );
+   window* w = _windows[number].load( std::memory_order_acquire );
+   if( w == nullptr )
+   {
+      // windows may extend past the end of the file, the mapping covers blocks appended later
+      std::unique_ptr<window> created( _segmented
+                                       ? new window( segment_filename( number ), 0, size_t(1) << window_bits )
+                                       : new window( _blocks_filename, number << window_bits, size_t(1) << window_bits ) );
+      window* expected = nullptr;
+      if( _windows[number].compare_exchange_strong( expected, created.get(), std::memory_order_acq_rel ) )
+         w = created.release();
+      else
+         w = expected;
+   }
+   return (const char*)w->region.get_address();
+}
+
+const char* block_database::map_range( uint64_t pos, size_t size, std::unique_ptr<window>& temp )const
+{
+   const uint64_t first = pos >> window_bits;
+   const uint64_t last  = ( pos + size - 1 ) >> window_bits;
+   if( first == last )
+      return map_window( first ) + ( pos - ( first << window_bits ) );
+   // rare, ranges crossing a window boundary get a mapping of their own, segments never split a range
+   FC_ASSERT( !_segmented, "Range crosses the end of a segment" );
+   const uint64_t offset = first << window_bits;
+   temp.reset( new window( _blocks_filename, offset, size_t( pos + size - offset ) ) );
+   return (const char*)temp->region.get_address() + ( pos - offset );
+}
+
+optional<signed_block> block_database::read_block( const index_entry& e )const
+{
+   const uint64_t pos  = e.block_pos.value();
+   const uint32_t size = e.block_size.value();
+   if( size == 0 || pos + size > _blocks_size.load( std::memory_order_acquire ) )
+      return optional<signed_block>();
+
+   optional<signed_block> result;
+   if( _compressed )
+      result = read_compressed_block( pos, size );
+   else
+   {
+      std::unique_ptr<window> temp;
+      fc::datastream<const char*> ds( map_range( pos, size, temp ), size );
+      result = signed_block();
+      fc::raw::unpack( ds, *result );
+   }
+   FC_ASSERT( result->id() == e.block_id );
+   _read_position.store( pos + size, std::memory_order_relaxed );
+   return result;
+}
+
+optional<signed_block> block_database::read_compressed_block( uint64_t pos, uint32_t size )const
+{
+   signed_block result;
+   std::shared_ptr<const frame_data> frame;
+   frame_entry f;
+   {
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      if( pos >= _tail_begin )
+      {
+         const uint64_t offset = pos - _tail_begin;
+         FC_ASSERT( offset + size <= _tail.size() );
+         fc::datastream<const char*> ds( _tail.data() + offset, size );
+         fc::raw::unpack( ds, result );
+         return result;
+      }
+      auto cached = std::find_if( _frame_cache.begin(), _frame_cache.end(),
+                                  [pos,size]( const std::shared_ptr<const frame_data>& fd ) {
+         return fd->block_pos <= pos && pos + size <= fd->block_pos + fd->data.size();
+      });
+      if( cached != _frame_cache.end() )
+      {
+         frame = *cached;
+         std::rotate( _frame_cache.begin(), cached, cached + 1 );
+      }
+      else
+      {
+         auto itr = std::upper_bound( _frames.begin(), _frames.end(), pos,
+                                      []( uint64_t p, const frame_entry& fe ) { return p < fe.block_pos.value(); } );
+         FC_ASSERT( itr != _frames.begin() );
+         f = *(itr - 1);
+      }
+   }
+
+   if( !frame )
+   {
+      // decompress outside of the lock, concurrent readers of the same frame may do the work twice
+      auto data = std::make_shared<frame_data>();
+      data->block_pos = f.block_pos.value();
+      data->data.resize( f.uncompressed_size.value() );
+      uLongf data_size = data->data.size();
+      std::unique_ptr<window> temp;
+      const char* compressed = map_range( f.file_pos.value(), f.compressed_size.value(), temp );
+      FC_ASSERT( uncompress( (Bytef*)data->data.data(), &data_size, (const Bytef*)compressed,
+                             f.compressed_size.value() ) == Z_OK && data_size == data->data.size(),
+                 "Failed to decompress the frame at ${p}", ("p", f.file_pos.value()) );
+      frame = data;
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      _frame_cache.insert( _frame_cache.begin(), frame );
+      if( _frame_cache.size() > frame_cache_size )
+         _frame_cache.pop_back();
+   }
+
+   FC_ASSERT( pos + size <= frame->block_pos + frame->data.size() );
+   fc::datastream<const char*> ds( frame->data.data() + ( pos - frame->block_pos ), size );
+   fc::raw::unpack( ds, result );
+   return result;
 }
 
 void block_database::store( const block_id_type& _id, const signed_block& b )
@@ -87,34 +614,113 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
-   _block_num_to_pos.seekp( sizeof( index_entry ) * int64_t(block_header::num_from_id(id)) );
    index_entry e;
-   _blocks.seekp( 0, _blocks.end );
    auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
+   e.block_pos  = _blocks_size.load( std::memory_order_relaxed );
    e.block_size = vec.size();
    e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   if( _compressed )
+      store_compressed( vec );
+   else
+   {
+      e.block_pos = append_blocks_data( vec.data(), vec.size() );
+      _blocks_size.store( _blocks_file_size, std::memory_order_release );
+   }
+   const uint32_t block_num = block_header::num_from_id(id);
+   write_entry( block_num, e );
+   if( _compressed && ++_tail_blocks >= _blocks_per_frame )
+      seal_frame();
+   if( _retain_blocks > 0 && block_num > _retain_blocks
+         && block_num - _retain_blocks >= first_block_num() + prune_interval )
+      prune( block_num - _retain_blocks + 1 );
 }
 
+void block_database::prune( uint32_t first_block )
+{ try {
+   // the oldest retained block marks the end of the region that can be released
+   index_entry e;
+   uint32_t block_num = first_block;
+   while( read_entry( block_num, e ) && e.block_size.value() == 0 )
+      ++block_num;
+   if( e.block_size.value() == 0 )
+      return;
+   uint64_t end = e.block_pos.value();
+   if( _compressed )
+   {
+      std::lock_guard<std::mutex> lock( _frames_mutex );
+      if( end >= _tail_begin )
+         end = _blocks_file_size;
+      else
+      {
+         auto itr = std::upper_bound( _frames.begin(), _frames.end(), end,
+                                      []( uint64_t p, const frame_entry& fe ) { return p < fe.block_pos.value(); } );
+         end = ( itr - 1 )->file_pos.value();
+      }
+   }
+
+   // persist the new limit before the data goes away, readers check it before touching a block
+   {
+      std::ofstream out( ( _first_block_filename.generic_string() + ".tmp" ).c_str(),
+                         std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      out << first_block;
+      out.flush();
+      FC_ASSERT( out, "Failed to write the first block number" );
+   }
+   fc::rename( _first_block_filename.generic_string() + ".tmp", _first_block_filename );
+   _first_block.store( first_block, std::memory_order_release );
+
+   // readers are done with the mappings retired by the previous run long ago
+   _retired_windows.clear();
+   if( _segmented )
+   {
+      for( ; _first_segment < ( _blocks_file_size >> window_bits ) && ( ( _first_segment + 1 ) << window_bits ) <= end;
+             ++_first_segment )
+      {
+         window* w = _windows[_first_segment].exchange( nullptr );
+         if( w != nullptr )
+            _retired_windows.emplace_back( w );
+         if( fc::exists( segment_filename( _first_segment ) ) )
+            fc::remove( segment_filename( _first_segment ) );
+      }
+      return;
+   }
+
+#ifdef __linux__
+   // already released ranges are punched again, which costs nothing, the file size is kept so that all
+   // positions stay valid
+   end &= ~uint64_t( 4095 );
+   if( end == 0 ) return;
+   int fd = ::open( _blocks_filename.generic_string().c_str(), O_WRONLY );
+   FC_ASSERT( fd >= 0, "Failed to open ${f} for pruning", ("f", _blocks_filename) );
+   const int result = ::fallocate( fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, off_t( end ) );
+   ::close( fd );
+   if( result != 0 )
+      wlog( "Failed to release the space of pruned blocks, the file system may not support hole punching" );
+#else
+   wlog( "Releasing the space of pruned blocks is not supported on this platform" );
+#endif
+} FC_CAPTURE_AND_RETHROW( (first_block) ) }
+
 void block_database::remove( const block_id_type& id )
 { try {
    index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   const uint32_t block_num = block_header::num_from_id(id);
+   if( !read_entry( block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    if( e.block_id == id )
    {
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e) * int64_t(block_header::num_from_id(id)) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      write_entry( block_num, e );
    }
+
+   // cut removed blocks off the end of the index so that last_id() stays cheap, the file keeps its size because
+   // readers may still copy entries beyond the new end from the mappings, open() drops them
+   uint32_t size = _index_size;
+   while( size > 0 && read_entry( size - 1, e ) && e.block_size.value() == 0 )
+      --size;
+   if( size < _index_size )
+      _index_size.store( size, std::memory_order_release );
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
 bool block_database::contains( const block_id_type& id )const
@@ -123,12 +729,8 @@ bool block_database::contains( const block_id_type& id )const
       return false;
 
    index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() < int64_t(index_pos + sizeof(e)) )
+   if( !read_entry( block_header::num_from_id(id), e ) )
       return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
 
    return e.block_id == id && e.block_size.value() > 0;
 }
@@ -137,14 +739,9 @@ block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
    index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_num);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   if( !read_entry( block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
    return e.block_id;
 }
@@ -154,23 +751,13 @@ optional<signed_block> block_database::fetch_optional( const block_id_type& id )
    try
    {
       index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      const uint32_t block_num = block_header::num_from_id(id);
+      if( block_num < first_block_num() || !read_entry( block_num, e ) )
          return {};
 
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
       if( e.block_id != id ) return optional<signed_block>();
 
-      vector<char> data( e.block_size.value() );
-      _blocks.seekg( e.block_pos.value() );
-      if (e.block_size.value())
-         _blocks.read( data.data(), e.block_size.value() );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( e );
    }
    catch (const fc::exception&)
    {
@@ -186,20 +773,10 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    try
    {
       index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_num);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      if( block_num < first_block_num() || !read_entry( block_num, e ) )
          return {};
 
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size.value() );
-      _blocks.seekg( e.block_pos.value() );
-      _blocks.read( data.data(), e.block_size.value() );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( e );
    }
    catch (const fc::exception&)
    {
@@ -211,53 +788,11 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 }
 
 optional<index_entry> block_database::last_index_entry()const {
-   try
-   {
-      index_entry e;
-
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      std::streampos pos = _block_num_to_pos.tellg();
-      if( pos < long(sizeof(index_entry)) )
-         return optional<index_entry>();
-
-      pos -= pos % sizeof(index_entry);
-
-      _blocks.seekg( 0, _block_num_to_pos.end );
-      const std::streampos blocks_size = _blocks.tellg();
-      while( pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-         if( _block_num_to_pos.gcount() == sizeof(e) && e.block_size.value() > 0
-                && int64_t(e.block_pos.value() + e.block_size.value()) <= blocks_size )
-            try
-            {
-               vector<char> data( e.block_size.value() );
-               _blocks.seekg( e.block_pos.value() );
-               _blocks.read( data.data(), e.block_size.value() );
-               if( _blocks.gcount() == long(e.block_size.value()) )
-               {
-                  const signed_block block = fc::raw::unpack<signed_block>(data);
-                  if( block.id() == e.block_id )
-                     return e;
-               }
-            }
-            catch (const fc::exception&)
-            {
-            }
-            catch (const std::exception&)
-            {
-            }
-         fc::resize_file( _index_filename, pos );
-      }
-   }
-   catch (const fc::exception&)
-   {
-   }
-   catch (const std::exception&)
-   {
-   }
+   // invalid trailing entries have been dropped by open(), removed blocks are skipped
+   index_entry e;
+   for( uint32_t block_num = _index_size.load( std::memory_order_acquire ); block_num > 0; --block_num )
+      if( read_entry( block_num - 1, e ) && e.block_size.value() > 0 )
+         return e;
    return optional<index_entry>();
 }
 
@@ -277,13 +812,12 @@ optional<block_id_type> block_database::last_id()const
 
 size_t block_database::blocks_current_position()const
 {
-   return (size_t)_blocks.tellg();
+   return (size_t)_read_position.load( std::memory_order_relaxed );
 }
 
 size_t block_database::total_block_size()const
 {
-   _blocks.seekg( 0, _blocks.end );
-   return (size_t)_blocks.tellg();
+   return (size_t)_blocks_size.load( std::memory_order_acquire );
 }
 
 } }
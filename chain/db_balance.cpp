@@ -35,10 +35,10 @@ namespace graphene { namespace chain {
 asset database::get_balance(account_id_type owner, asset_id_type asset_id) const
 {
    auto& index = get_index_type< primary_index< account_balance_index > >().get_secondary_index<balances_by_account_index>();
-   auto abo = index.get_account_balance( owner, asset_id );
-   if( !abo )
+   auto entry = index.find_balance( owner, asset_id );
+   if( !entry )
       return asset(0, asset_id);
-   return abo->get_balance();
+   return asset( entry->balance, asset_id );
 }
 
 asset database::get_balance(const account_object& owner, const asset_object& asset_obj) const
@@ -98,8 +98,8 @@ void database::adjust_balance(account_id_type account, asset delta )
       return;
 
    auto& index = get_index_type< primary_index< account_balance_index > >().get_secondary_index<balances_by_account_index>();
-   auto abo = index.get_account_balance( account, delta.asset_id );
-   if( !abo )
+   auto entry = index.find_balance( account, delta.asset_id );
+   if( !entry )
    {
       FC_ASSERT( delta.amount > 0, "Insufficient Balance: ${a}'s balance of ${b} is less than required ${r}", 
                  ("a",account(*this).name)
@@ -114,9 +114,9 @@ void database::adjust_balance(account_id_type account, asset delta )
       });
    } else {
       if( delta.amount < 0 )
-         FC_ASSERT( abo->get_balance() >= -delta, "Insufficient Balance: ${a}'s balance of ${b} is less than required ${r}",
-                    ("a",account(*this).name)("b",to_pretty_string(abo->get_balance()))("r",to_pretty_string(-delta)));
-      modify(*abo, [delta](account_balance_object& b) {
+         FC_ASSERT( entry->balance >= -delta.amount, "Insufficient Balance: ${a}'s balance of ${b} is less than required ${r}",
+                    ("a",account(*this).name)("b",to_pretty_string(asset(entry->balance,delta.asset_id)))("r",to_pretty_string(-delta)));
+      modify(*entry->object, [delta](account_balance_object& b) {
          b.adjust_balance(delta);
       });
    }
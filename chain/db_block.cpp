@@ -80,6 +80,18 @@ optional<signed_block> database::fetch_block_by_number( uint32_t num )const
       return _block_id_to_block.fetch_by_number(num);
 }
 
+uint32_t database::get_first_stored_block_num()const
+{
+   return _block_id_to_block.first_block_num();
+}
+
+void database::set_block_log_pruning( uint32_t retain_blocks )
+{
+   FC_ASSERT( retain_blocks == 0 || retain_blocks >= GRAPHENE_MAX_UNDO_HISTORY,
+              "At least ${n} blocks have to be kept", ("n", GRAPHENE_MAX_UNDO_HISTORY) );
+   _block_id_to_block.set_pruning( retain_blocks );
+}
+
 const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
    auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
@@ -115,6 +127,7 @@ std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of
 bool database::push_block(const signed_block& new_block, uint32_t skip)
 {
 //   idump((new_block.block_num())(new_block.id())(new_block.timestamp)(new_block.previous));
+   auto write = start_write_section();
    bool result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -227,6 +240,7 @@ processed_transaction database::push_transaction( const precomputable_transactio
 { try {
    // see https://github.com/msc-dev/msc-core/issues/1573
    FC_ASSERT( fc::raw::pack_size( trx ) < (1024 * 1024), "Transaction exceeds maximum transaction size." );
+   auto write = start_write_section();
    processed_transaction result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -262,6 +276,7 @@ processed_transaction database::_push_transaction( const precomputable_transacti
 
 processed_transaction database::validate_transaction( const signed_transaction& trx )
 {
+   auto write = start_write_section();
    auto session = _undo_db.start_undo_session();
    return _apply_transaction( trx );
 }
@@ -331,6 +346,7 @@ signed_block database::generate_block(
    uint32_t skip /* = 0 */
    )
 { try {
+   auto write = start_write_section();
    signed_block result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -462,6 +478,7 @@ signed_block database::_generate_block(
  */
 void database::pop_block()
 { try {
+   auto write = start_write_section();
    _pending_tx_session.reset();
    auto fork_db_head = _fork_db.head();
    FC_ASSERT( fork_db_head, "Trying to pop() from empty fork database!?" );
@@ -478,6 +495,7 @@ void database::pop_block()
 
 void database::clear_pending()
 { try {
+   auto write = start_write_section();
    assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
    _pending_tx.clear();
    _pending_tx_session.reset();
@@ -564,6 +582,8 @@ void database::_apply_block( const signed_block& next_block )
    _current_trx_in_block = 0;
 
    _issue_453_affected_assets.clear();
+   // only feeds of this block, feeds of pending transactions were undone
+   _pending_median_feed_updates.clear();
 
    for( const auto& trx : next_block.transactions )
    {
@@ -594,6 +614,7 @@ void database::_apply_block( const signed_block& next_block )
    clear_expired_proposals();
    clear_expired_orders();
    clear_expired_htlcs();
+   update_pending_median_feeds(); // median feeds of the feeds published in this block
    update_expired_feeds();       // this will update expired feeds and some core exchange rates
    update_core_exchange_rates(); // this will update remaining core exchange rates
    update_withdraw_permissions();
@@ -852,6 +873,17 @@ fc::future<void> database::precompute_parallel( const signed_block& block, const
    return *first;
 } FC_LOG_AND_RETHROW() }
 
+void database::precompute_block( const signed_block& block, const uint32_t skip )const
+{
+   if( !block.transactions.empty() )
+      _precompute_parallel( &block.transactions[0], block.transactions.size(), skip );
+   if( !(skip&skip_witness_signature) )
+      block.signee();
+   if( !(skip&skip_merkle_check) )
+      block.calculate_merkle_root();
+   block.id();
+}
+
 fc::future<void> database::precompute_parallel( const precomputable_transaction& trx )const
 {
    return fc::do_parallel([this,&trx] () {
@@ -195,18 +195,24 @@ void database::initialize_indexes()
 
    add_index< primary_index<committee_member_index, 8> >(); // 256 members per chunk
    add_index< primary_index<witness_index, 10> >(); // 1024 witnesses per chunk
-   add_index< primary_index<limit_order_index > >();
-   add_index< primary_index<call_order_index > >();
+   auto limit_order_idx = add_index< primary_index<limit_order_index, hashed_ids > >();
+   limit_order_idx->add_secondary_index<limit_order_book_index>();
+   limit_order_idx->add_secondary_index<limit_order_expiration_index>();
+   auto call_order_idx = add_index< primary_index<call_order_index > >();
+   call_order_idx->add_secondary_index<call_order_trigger_index>();
 
-   auto prop_index = add_index< primary_index<proposal_index > >();
+   auto prop_index = add_index< primary_index<proposal_index, hashed_ids > >();
    prop_index->add_secondary_index<required_approval_index>();
+   prop_index->add_secondary_index<proposal_expiration_index>();
 
-   add_index< primary_index<withdraw_permission_index > >();
+   auto withdraw_permission_idx = add_index< primary_index<withdraw_permission_index > >();
+   withdraw_permission_idx->add_secondary_index<withdraw_permission_expiration_index>();
    add_index< primary_index<vesting_balance_index> >();
    add_index< primary_index<worker_index> >();
    add_index< primary_index<balance_index> >();
    add_index< primary_index<blinded_balance_index> >();
-   add_index< primary_index< htlc_index> >();
+   auto htlc_idx = add_index< primary_index< htlc_index, hashed_ids > >();
+   htlc_idx->add_secondary_index<htlc_expiration_index>();
 
    //Implementation object indexes
    add_index< primary_index<transaction_index                             > >();
@@ -227,6 +233,9 @@ void database::initialize_indexes()
    add_index< primary_index< buyback_index                                > >();
    add_index< primary_index<collateral_bid_index                          > >();
    add_index< primary_index< simple_index< fba_accumulator_object       > > >();
+
+   // recent transactions are not recorded while replaying, everything else must be identical on all nodes
+   mark_state_indexes( { { transaction_history_object::space_id, transaction_history_object::type_id } } );
 }
 
 void database::init_genesis(const genesis_state_type& genesis_state)
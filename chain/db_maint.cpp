@@ -707,11 +707,17 @@ void create_buyback_orders( database& db )
          continue;
       }
 
-      for( const auto& entry : bal_idx.get_account_balances( buyback_account.id ) )
+      // Filling an order below may add a balance to this row and reallocate it, so iterate a copy
+      vector< pair< asset_id_type, share_type > > holdings;
+      const auto& row = bal_idx.get_account_balances( buyback_account.id );
+      holdings.reserve( row.size() );
+      for( const auto& entry : row )
+         holdings.emplace_back( entry.asset_type, entry.balance );
+
+      for( const auto& holding : holdings )
       {
-         const auto* it = entry.second;
-         asset_id_type asset_to_sell = it->asset_type;
-         share_type amount_to_sell = it->balance;
+         asset_id_type asset_to_sell = holding.first;
+         share_type amount_to_sell = holding.second;
          if( asset_to_sell == asset_to_buy.id )
             continue;
          if( amount_to_sell == 0 )
@@ -1028,36 +1034,35 @@ void process_hf_868_890( database& db, bool skip_check_call_orders )
       const asset_bitasset_data_object& bitasset_data = current_asset.bitasset_data(db);
       // NOTE: We'll only need old_feed if HF343 hasn't rolled out yet
       auto old_feed = bitasset_data.current_feed;
-      bool feeds_changed = false; // did any feed change
-      auto itr = bitasset_data.feeds.begin();
-      while( itr != bitasset_data.feeds.end() )
+      // collect the invalid feeds first, the feeds are copied on write so their iterators must not be
+      // used across the modification
+      vector<account_id_type> invalid_feeds;
+      for( const auto& feed : bitasset_data.feeds )
       {
-         // If the feed is invalid
-         if ( itr->second.second.settlement_price.quote.asset_id != bitasset_data.options.short_backing_asset
-               && ( is_witness_or_committee_fed || itr->second.second.settlement_price != price() ) )
+         if ( feed.second.second.settlement_price.quote.asset_id != bitasset_data.options.short_backing_asset
+               && ( is_witness_or_committee_fed || feed.second.second.settlement_price != price() ) )
+            invalid_feeds.push_back( feed.first );
+      }
+      bool feeds_changed = !invalid_feeds.empty(); // did any feed change
+      if( feeds_changed )
+      {
+         db.modify( bitasset_data, [&invalid_feeds, is_witness_or_committee_fed]( asset_bitasset_data_object& obj )
          {
-            feeds_changed = true;
-            db.modify( bitasset_data, [&itr, is_witness_or_committee_fed]( asset_bitasset_data_object& obj )
+            for( const auto& publisher : invalid_feeds )
             {
                if( is_witness_or_committee_fed )
                {
                   // erase the invalid feed
-                  itr = obj.feeds.erase(itr);
+                  obj.feeds.erase( publisher );
                }
                else
                {
                   // nullify the invalid feed
-                  obj.feeds[itr->first].second.settlement_price = price();
-                  ++itr;
+                  obj.feeds[publisher].second.settlement_price = price();
                }
-            });
-         }
-         else
-         {
-            // Feed is valid. Skip it.
-            ++itr;
-         }
-      } // end loop of each feed
+            }
+         });
+      }
 
       // if any feed was modified, print a warning message
       if( feeds_changed )
@@ -31,12 +31,16 @@
 
 #include <graphene/protocol/fee_schedule.hpp>
 
+#include <fc/asio.hpp>
 #include <fc/io/fstream.hpp>
+#include <fc/thread/parallel.hpp>
 
 #include <fstream>
 #include <functional>
 #include <iostream>
-#include <queue>
+#include <cmath>
+#include <deque>
+#include <memory>
 #include <tuple>
 
 namespace graphene { namespace chain {
@@ -52,6 +56,31 @@ database::~database()
    clear_pending();
 }
 
+namespace {
+   /** unpacked blocks with their precomputed data take about this many times their packed size */
+   const double unpacked_block_expansion = 4;
+
+   /** time spent by each stage of the reindex pipeline in one progress interval */
+   struct reindex_stage_stats
+   {
+      uint64_t blocks        = 0;
+      int64_t  read_us       = 0; ///< summed over all workers
+      int64_t  precompute_us = 0; ///< summed over all workers
+      int64_t  apply_us      = 0;
+      int64_t  wait_us       = 0; ///< apply loop waiting for the read ahead
+
+      void log( size_t read_ahead_blocks )const
+      {
+         const auto rate = [this]( int64_t us ) { return us > 0 ? uint64_t( blocks * 1000000 / us ) : 0; };
+         ilog( "   [read: ${r} blocks/s per worker]   [precompute: ${p} blocks/s per worker]   "
+               "[apply: ${a} blocks/s, waited ${w}%]   [read ahead: ${n} blocks]",
+               ("r", rate( read_us ))("p", rate( precompute_us ))("a", rate( apply_us + wait_us ))
+               ("w", apply_us + wait_us > 0 ? wait_us * 100 / ( apply_us + wait_us ) : 0)
+               ("n", read_ahead_blocks) );
+      }
+   };
+}
+
 void database::reindex( fc::path data_dir )
 { try {
    auto last_block = _block_id_to_block.last();
@@ -61,11 +90,23 @@ void database::reindex( fc::path data_dir )
       return;
    }
    if( last_block->block_num() <= head_block_num()) return;
+   FC_ASSERT( head_block_num() + 1 >= _block_id_to_block.first_block_num(),
+              "Blocks before ${first} have been pruned, the chain state can not be rebuilt from the block log. "
+              "Resync the blockchain instead.", ("first", _block_id_to_block.first_block_num()) );
+   // the state hash check can only run while applying its block, refuse to start a replay that skips it
+   if( _replay_state_check.valid() )
+      FC_ASSERT( _replay_state_check->first > head_block_num()
+                    && _replay_state_check->first <= last_block->block_num(),
+                 "Can not verify the state hash at block ${n}, the replay covers blocks ${first} to ${last}",
+                 ("n",_replay_state_check->first)("first",head_block_num() + 1)("last",last_block->block_num()) );
 
    ilog( "reindexing blockchain" );
    auto start = fc::time_point::now();
    const auto last_block_num = last_block->block_num();
    uint32_t undo_point = last_block_num < GRAPHENE_MAX_UNDO_HISTORY ? 0 : last_block_num - GRAPHENE_MAX_UNDO_HISTORY;
+   // blocks up to the last checkpoint can not be reverted either, apply them without undo and fork database
+   if( !_checkpoints.empty() )
+      undo_point = std::max( undo_point, std::min( _checkpoints.rbegin()->first, last_block_num ) );
 
    ilog( "Replaying blocks, starting at ${next}...", ("next",head_block_num() + 1) );
    if( head_block_num() >= undo_point )
@@ -78,27 +119,105 @@ void database::reindex( fc::path data_dir )
 
    uint32_t skip = node_properties().skip_flags;
 
+   // indexes which are not consulted while applying blocks are rebuilt once at the end, also if replaying fails
+   struct deferred_index_rebuilder {
+      deferred_index_rebuilder(database& db) : db(db) { db.defer_secondary_indexes( true ); }
+      ~deferred_index_rebuilder()
+      {
+         try {
+            db.defer_secondary_indexes( false );
+         } catch( const fc::exception& e ) {
+            elog( "Failed to rebuild deferred secondary indexes: ${e}", ("e", e.to_detail_string()) );
+         } catch( ... ) {
+            elog( "Failed to rebuild deferred secondary indexes" );
+         }
+      }
+   private:
+      database& db;
+   } rebuilder(*this);
+
    size_t total_block_size = _block_id_to_block.total_block_size();
    const auto& gpo = get_global_properties();
-   std::queue< std::tuple< size_t, signed_block, fc::future< void > > > blocks;
+   const fc::time_point_sec dupe_check_start = last_block->timestamp - gpo.parameters.maximum_time_until_expiration;
+
+   // Blocks are read, unpacked and precomputed in batches by parallel tasks running ahead of the apply loop,
+   // so that applying never waits for I/O or signature recovery. A missing block ends its batch, the apply
+   // loop handles the gap once it gets there.
+   struct reindex_batch
+   {
+      vector< optional<signed_block> > blocks;
+      vector< size_t >                 sizes;
+      uint64_t                         bytes = 0;
+      int64_t                          read_us = 0;
+      int64_t                          precompute_us = 0;
+      fc::future<void>                 done;
+   };
+   const uint32_t batch_size = 50;
+   const size_t   workers = std::max<size_t>( 1, fc::asio::default_io_service_scope::get_num_threads() );
+   std::deque< std::shared_ptr<reindex_batch> > batches;
+   const auto start_batch = [this,&batches,skip,dupe_check_start]( uint32_t first, uint32_t count ) {
+      auto batch = std::make_shared<reindex_batch>();
+      batch->blocks.resize( count );
+      batch->sizes.resize( count );
+      batch->done = fc::do_parallel( [this,batch,first,count,skip,dupe_check_start] () {
+         for( uint32_t k = 0; k < count; ++k )
+         {
+            const auto read_start = fc::time_point::now();
+            optional<signed_block>& block = batch->blocks[k];
+            block = _block_id_to_block.fetch_by_number( first + k );
+            if( !block.valid() )
+               break;
+            batch->sizes[k] = fc::raw::pack_size( *block );
+            batch->bytes += batch->sizes[k];
+            const auto precompute_start = fc::time_point::now();
+            precompute_block( *block, block->timestamp >= dupe_check_start ? skip & ~skip_transaction_dupe_check : skip );
+            batch->read_us       += ( precompute_start - read_start ).count();
+            batch->precompute_us += ( fc::time_point::now() - precompute_start ).count();
+         }
+      });
+      batches.push_back( batch );
+   };
+
+   // The read ahead is sized from the measured cost of a batch: while one batch is applied, a worker gets
+   // through apply / (read + precompute) of a batch, so about (read + precompute) / apply batches have to be in
+   // flight to keep the apply loop busy. It is limited by the number of workers and by the memory budget.
+   const uint64_t max_memory = _reindex_memory_budget;
+   double   avg_work_us  = 0;
+   double   avg_apply_us = 0;
+   double   avg_bytes    = 0;
+   size_t   read_ahead   = 2 * workers;
+   reindex_stage_stats interval;
+
+   size_t processed_block_size = 0;
+   bool replay_state_checked = false;
    uint32_t next_block_num = head_block_num() + 1;
    uint32_t i = next_block_num;
-   while( next_block_num <= last_block_num || !blocks.empty() )
+   try {
+   while( i <= last_block_num )
    {
-      if( next_block_num <= last_block_num && blocks.size() < 20 )
+      while( next_block_num <= last_block_num && batches.size() < read_ahead )
       {
-         const size_t processed_block_size = _block_id_to_block.blocks_current_position();
-         fc::optional< signed_block > block = _block_id_to_block.fetch_by_number( next_block_num++ );
-         if( block.valid() )
-         {
-            if( block->timestamp >= last_block->timestamp - gpo.parameters.maximum_time_until_expiration )
-               skip &= ~skip_transaction_dupe_check;
-            blocks.emplace( processed_block_size, std::move(*block), fc::future<void>() );
-            std::get<2>(blocks.back()) = precompute_parallel( std::get<1>(blocks.back()), skip );
-         }
-         else
+         const uint32_t count = std::min( batch_size, last_block_num - next_block_num + 1 );
+         start_batch( next_block_num, count );
+         next_block_num += count;
+      }
+      auto batch = batches.front();
+      batches.pop_front();
+      const auto wait_start = fc::time_point::now();
+      batch->done.wait();
+      const auto apply_start = fc::time_point::now();
+      interval.wait_us       += ( apply_start - wait_start ).count();
+      interval.read_us       += batch->read_us;
+      interval.precompute_us += batch->precompute_us;
+
+      for( size_t k = 0; k < batch->blocks.size() && i <= last_block_num; ++k )
+      {
+         if( !batch->blocks[k].valid() )
          {
             wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
+            for( auto& pending : batches )
+               pending->done.wait();
+            batches.clear();
             uint32_t dropped_count = 0;
             while( true )
             {
@@ -114,28 +233,31 @@ void database::reindex( fc::path data_dir )
             }
             wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
             next_block_num = last_block_num + 1; // don't load more blocks
+            i = last_block_num + 1;
+            break;
          }
-      }
-      else
-      {
-         std::get<2>(blocks.front()).wait();
-         const signed_block& block = std::get<1>(blocks.front());
+         const signed_block& block = *batch->blocks[k];
+         if( block.timestamp >= dupe_check_start )
+            skip &= ~skip_transaction_dupe_check;
+         processed_block_size += batch->sizes[k];
 
          if( i % 10000 == 0 )
          {
             std::stringstream bysize;
             std::stringstream bynum;
-            bysize << std::fixed << std::setprecision(5) << double(std::get<0>(blocks.front())) / total_block_size * 100;
+            bysize << std::fixed << std::setprecision(5) << double(processed_block_size) / total_block_size * 100;
             bynum << std::fixed << std::setprecision(5) << double(i*100)/last_block_num;
             ilog(
                "   [by size: ${size}%   ${processed} of ${total}]   [by num: ${num}%   ${i} of ${last}]",
                ("size", bysize.str())
-               ("processed", std::get<0>(blocks.front()))
+               ("processed", processed_block_size)
                ("total", total_block_size)
                ("num", bynum.str())
                ("i", i)
                ("last", last_block_num)
             );
+            interval.log( read_ahead * batch_size );
+            interval = reindex_stage_stats();
          }
          if( i == undo_point )
          {
@@ -150,15 +272,58 @@ void database::reindex( fc::path data_dir )
             _undo_db.enable();
             push_block( block, skip );
          }
-         blocks.pop();
+         if( _replay_state_check.valid() && _replay_state_check->first == i )
+         {
+            verify_replay_state();
+            replay_state_checked = true;
+         }
+         ++interval.blocks;
          i++;
       }
+
+      const int64_t apply_us = ( fc::time_point::now() - apply_start ).count();
+      interval.apply_us += apply_us;
+      const double weight = avg_apply_us == 0 ? 1.0 : 0.1;
+      avg_work_us  += weight * ( batch->read_us + batch->precompute_us - avg_work_us );
+      avg_apply_us += weight * ( apply_us - avg_apply_us );
+      avg_bytes    += weight * ( batch->bytes - avg_bytes );
+      const size_t needed = size_t( std::ceil( avg_work_us / std::max( avg_apply_us, 1.0 ) ) ) + 2;
+      const size_t memory_limit = size_t( max_memory / std::max( avg_bytes * unpacked_block_expansion, 1.0 ) );
+      read_ahead = std::max<size_t>( 2, std::min( { needed, workers + 2, memory_limit } ) );
+   }
+   } catch( ... ) {
+      // the read ahead tasks use the block database
+      for( auto& pending : batches )
+         try { pending->done.wait(); } catch( ... ) {}
+      throw;
    }
    _undo_db.enable();
+   // a gap in the block log ends the replay early
+   FC_ASSERT( !_replay_state_check.valid() || replay_state_checked,
+              "The replay stopped at block ${h} before the state hash at block ${n} could be verified",
+              ("h",head_block_num())("n",_replay_state_check->first) );
+   _replay_state_check.reset();
+   ilog( "Rebuilding deferred secondary indexes" );
+   defer_secondary_indexes( false );
    auto end = fc::time_point::now();
    ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
+void database::set_replay_state_check( uint32_t block_num, const fc::sha256& expected_hash )
+{
+   _replay_state_check = std::make_pair( block_num, expected_hash );
+}
+
+void database::verify_replay_state()const
+{
+   ilog( "Verifying state hash at block ${n}", ("n",_replay_state_check->first) );
+   const auto state_hash = get_state_hash();
+   FC_ASSERT( state_hash == _replay_state_check->second,
+              "State hash mismatch after replaying block ${n}: expected ${e}, got ${h}",
+              ("n",_replay_state_check->first)("e",_replay_state_check->second)("h",state_hash) );
+   ilog( "State hash at block ${n} verified", ("n",_replay_state_check->first) );
+}
+
 void database::wipe(const fc::path& data_dir, bool include_blocks)
 {
    ilog("Wiping database", ("include_blocks", include_blocks));
@@ -192,6 +357,7 @@ void database::open(
 {
    try
    {
+      auto write = start_write_section();
       bool wipe_object_db = false;
       if( !fc::exists( data_dir / "db_version" ) )
          wipe_object_db = true;
@@ -259,6 +425,7 @@ void database::close(bool rewind)
    if (!_opened)
       return;
       
+   auto write = start_write_section();
    // TODO:  Save pending tx's on close()
    clear_pending();
 
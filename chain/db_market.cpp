@@ -160,6 +160,46 @@ void database::_cancel_bids_and_revive_mpa( const asset_object& bitasset, const
            });
 } FC_CAPTURE_AND_RETHROW( (bitasset) ) }
 
+void database::process_median_feed_change( const asset_object& mia, const asset_bitasset_data_object& bad )
+{
+   // Check whether need to revive the asset and proceed if need
+   if( bad.has_settlement() // has globally settled, implies head_block_time > HARDFORK_CORE_216_TIME
+       && !bad.current_feed.settlement_price.is_null() ) // has a valid feed
+   {
+      bool should_revive = false;
+      const auto& mia_dyn = mia.dynamic_asset_data_id(*this);
+      if( mia_dyn.current_supply == 0 ) // if current supply is zero, revive the asset
+         should_revive = true;
+      else // if current supply is not zero, when collateral ratio of settlement fund is greater than MCR, revive the asset
+      {
+         if( get_dynamic_global_properties().next_maintenance_time <= HARDFORK_CORE_1270_TIME )
+         {
+            // before core-1270 hard fork, calculate call_price and compare to median feed
+            if( ~price::call_price( asset(mia_dyn.current_supply, mia.id),
+                                    asset(bad.settlement_fund, bad.options.short_backing_asset),
+                                    bad.current_feed.maintenance_collateral_ratio ) < bad.current_feed.settlement_price )
+               should_revive = true;
+         }
+         else
+         {
+            // after core-1270 hard fork, calculate collateralization and compare to maintenance_collateralization
+            if( price( asset( bad.settlement_fund, bad.options.short_backing_asset ),
+                       asset( mia_dyn.current_supply, mia.id ) ) > bad.current_maintenance_collateralization )
+               should_revive = true;
+         }
+      }
+      if( should_revive )
+         revive_bitasset(mia);
+   }
+   // Process margin calls, allow black swan, not for a new limit order
+   check_call_orders( mia, true, false, &bad );
+}
+
+void database::defer_median_feed_update( const asset_bitasset_data_object& bitasset )
+{
+   _pending_median_feed_updates.insert( bitasset.id );
+}
+
 void database::cancel_bid(const collateral_bid_object& bid, bool create_virtual_op)
 {
    adjust_balance(bid.bidder, bid.inv_swan_price.base);
@@ -411,19 +451,18 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    asset_id_type recv_asset_id = new_order_object.receive_asset_id();
 
    // We only need to check if the new order will match with others if it is at the front of the book
-   const auto& limit_price_idx = get_index_type<limit_order_index>().indices().get<by_price>();
-   auto limit_itr = limit_price_idx.lower_bound( boost::make_tuple( new_order_object.sell_price, order_id ) );
-   if( limit_itr != limit_price_idx.begin() )
-   {
-      --limit_itr;
-      if( limit_itr->sell_asset_id() == sell_asset_id && limit_itr->receive_asset_id() == recv_asset_id )
-         return false;
-   }
+   const auto& order_books = get_index_type< primary_index< limit_order_index, hashed_ids > >()
+                                .get_secondary_index< limit_order_book_index >();
+   if( order_books.get_best_order( sell_asset_id, recv_asset_id ) != &new_order_object )
+      return false;
 
-   // this is the opposite side (on the book)
+   // this is the opposite side (on the book), it is matched from the best price on and every maker that is
+   // fully filled is removed from it, so the next maker is always the best order of the opposite book
    auto max_price = ~new_order_object.sell_price;
-   limit_itr = limit_price_idx.lower_bound( max_price.max() );
-   auto limit_end = limit_price_idx.upper_bound( max_price );
+   auto next_maker = [&order_books,&max_price,sell_asset_id,recv_asset_id]() -> const limit_order_object* {
+      const limit_order_object* best = order_books.get_best_order( recv_asset_id, sell_asset_id );
+      return ( best != nullptr && best->sell_price >= max_price ) ? best : nullptr;
+   };
 
    // Order matching should be in favor of the taker.
    // When a new limit order is created, e.g. an ask, need to check if it will match the highest bid.
@@ -484,12 +523,12 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    if( to_check_call_orders )
    {
       // check limit orders first, match the ones with better price in comparison to call orders
-      while( !finished && limit_itr != limit_end && limit_itr->sell_price > call_match_price )
+      for( const limit_order_object* maker = next_maker();
+           !finished && maker != nullptr && maker->sell_price > call_match_price;
+           maker = next_maker() )
       {
-         auto old_limit_itr = limit_itr;
-         ++limit_itr;
          // match returns 2 when only the old order was fully filled. In this case, we keep matching; otherwise, we stop.
-         finished = ( match( new_order_object, *old_limit_itr, old_limit_itr->sell_price ) != 2 );
+         finished = ( match( new_order_object, *maker, maker->sell_price ) != 2 );
       }
 
       if( !finished && !before_core_hardfork_1270 ) // TODO refactor or cleanup duplicate code after core-1270 hard fork
@@ -546,12 +585,10 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    }
 
    // still need to check limit orders
-   while( !finished && limit_itr != limit_end )
+   for( const limit_order_object* maker = next_maker(); !finished && maker != nullptr; maker = next_maker() )
    {
-      auto old_limit_itr = limit_itr;
-      ++limit_itr;
       // match returns 2 when only the old order was fully filled. In this case, we keep matching; otherwise, we stop.
-      finished = ( match( new_order_object, *old_limit_itr, old_limit_itr->sell_price ) != 2 );
+      finished = ( match( new_order_object, *maker, maker->sell_price ) != 2 );
    }
 
    const limit_order_object* updated_order_object = find< limit_order_object >( order_id );
@@ -993,6 +1030,21 @@ bool database::check_call_orders( const asset_object& mia, bool enable_black_swa
 
     const asset_bitasset_data_object& bitasset = ( bitasset_ptr ? *bitasset_ptr : mia.bitasset_data(*this) );
 
+    // After core-1270 nothing can happen if even the least collateralized position is above the maintenance
+    // collateralization and is not undercollateralized at the maximum short squeeze price: the loop below
+    // would return on its first call order and check_for_blackswan() would find no black swan.
+    if( maint_time > HARDFORK_CORE_1270_TIME && !bitasset.has_settlement()
+          && !bitasset.current_feed.settlement_price.is_null() )
+    {
+       const call_order_object* least = find_least_collateralized_call( mia, bitasset );
+       if( least == nullptr )
+          return false;
+       const price least_collateralization = least->collateralization();
+       if( bitasset.current_maintenance_collateralization < least_collateralization
+             && ~least_collateralization < bitasset.current_feed.max_short_squeeze_price() )
+          return false;
+    }
+
     if( check_for_blackswan( mia, enable_black_swan, &bitasset ) )
        return false;
 
@@ -1187,6 +1239,23 @@ bool database::check_call_orders( const asset_object& mia, bool enable_black_swa
     return margin_called;
 } FC_CAPTURE_AND_RETHROW() }
 
+const call_order_object* database::find_least_collateralized_call( const asset_object& mia,
+                                                                  const asset_bitasset_data_object& bitasset )const
+{
+   const auto& call_idx = get_index_type< primary_index< call_order_index > >();
+   const auto& triggers = call_idx.get_secondary_index< call_order_trigger_index >();
+   const call_order_object* least = nullptr;
+   if( triggers.find_least_collateralized( mia.id, least ) )
+      return least;
+
+   const auto& call_collateral_index = call_idx.indices().get<by_collateral>();
+   auto call_itr = call_collateral_index.lower_bound( price::min( bitasset.options.short_backing_asset, mia.id ) );
+   if( call_itr != call_collateral_index.end() && call_itr->debt_type() == mia.id )
+      least = &(*call_itr);
+   triggers.set_least_collateralized( mia.id, least );
+   return least;
+}
+
 void database::pay_order( const account_object& receiver, const asset& receives, const asset& pays )
 {
    const auto& balances = receiver.statistics(*this);
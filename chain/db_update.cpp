@@ -172,10 +172,11 @@ void database::clear_expired_transactions()
 
 void database::clear_expired_proposals()
 {
-   const auto& proposal_expiration_index = get_index_type<proposal_index>().indices().get<by_expiration>();
-   while( !proposal_expiration_index.empty() && proposal_expiration_index.begin()->expiration_time <= head_block_time() )
+   const auto& expired_proposals = get_index_type< primary_index< proposal_index, hashed_ids > >()
+                                      .get_secondary_index< proposal_expiration_index >();
+   while( const proposal_object* proposal_ptr = expired_proposals.find_expired( head_block_time() ) )
    {
-      const proposal_object& proposal = *proposal_expiration_index.begin();
+      const proposal_object& proposal = *proposal_ptr;
       processed_transaction result;
       try {
          if( proposal.is_authorized_to_execute(*this) )
@@ -246,22 +247,14 @@ bool database::check_for_blackswan( const asset_object& mia, bool enable_black_s
        // due to #338, we won't check for black swan on incoming limit order, so need to check with MSSP here
        highest = bitasset.current_feed.max_short_squeeze_price_before_hf_1270();
 
-    const limit_order_index& limit_index = get_index_type<limit_order_index>();
-    const auto& limit_price_index = limit_index.indices().get<by_price>();
+    // looking for the limit order selling the most USD for the least CORE
+    const limit_order_object* best_bid = get_index_type< primary_index< limit_order_index, hashed_ids > >()
+                                            .get_secondary_index< limit_order_book_index >()
+                                            .get_best_order( mia.id, bitasset.options.short_backing_asset );
 
-    // looking for limit orders selling the most USD for the least CORE
-    auto highest_possible_bid = price::max( mia.id, bitasset.options.short_backing_asset );
-    // stop when limit orders are selling too little USD for too much CORE
-    auto lowest_possible_bid  = price::min( mia.id, bitasset.options.short_backing_asset );
-
-    FC_ASSERT( highest_possible_bid.base.asset_id == lowest_possible_bid.base.asset_id );
-    // NOTE limit_price_index is sorted from greatest to least
-    auto limit_itr = limit_price_index.lower_bound( highest_possible_bid );
-    auto limit_end = limit_price_index.upper_bound( lowest_possible_bid );
-
-    if( limit_itr != limit_end ) {
-       FC_ASSERT( highest.base.asset_id == limit_itr->sell_price.base.asset_id );
-       highest = std::max( limit_itr->sell_price, highest );
+    if( best_bid != nullptr ) {
+       FC_ASSERT( highest.base.asset_id == best_bid->sell_price.base.asset_id );
+       highest = std::max( best_bid->sell_price, highest );
     }
 
     auto least_collateral = call_ptr->collateralization();
@@ -300,10 +293,11 @@ void database::clear_expired_orders()
          bool before_core_hardfork_342 = ( maint_time <= HARDFORK_CORE_342_TIME ); // better rounding
          bool before_core_hardfork_606 = ( maint_time <= HARDFORK_CORE_606_TIME ); // feed always trigger call
 
-         auto& limit_index = get_index_type<limit_order_index>().indices().get<by_expiration>();
-         while( !limit_index.empty() && limit_index.begin()->expiration <= head_time )
+         const auto& expired_orders = get_index_type< primary_index< limit_order_index, hashed_ids > >()
+                                         .get_secondary_index< limit_order_expiration_index >();
+         while( const limit_order_object* order_ptr = expired_orders.find_expired( head_time ) )
          {
-            const limit_order_object& order = *limit_index.begin();
+            const limit_order_object& order = *order_ptr;
             auto base_asset = order.sell_price.base.asset_id;
             auto quote_asset = order.sell_price.quote.asset_id;
             cancel_limit_order( order );
@@ -500,6 +494,30 @@ void database::clear_expired_orders()
    }
 } FC_CAPTURE_AND_RETHROW() }
 
+void database::update_pending_median_feeds()
+{
+   if( _pending_median_feed_updates.empty() )
+      return;
+
+   const auto head_time = head_block_time();
+   const auto next_maint_time = get_dynamic_global_properties().next_maintenance_time;
+
+   // in id order, so that margin calls are processed in the same order on every node
+   for( asset_bitasset_data_id_type id : _pending_median_feed_updates )
+   {
+      const asset_bitasset_data_object* bad = find( id );
+      if( bad == nullptr )
+         continue;
+      auto old_feed = bad->current_feed;
+      modify( *bad, [head_time,next_maint_time]( asset_bitasset_data_object& abdo ) {
+         abdo.update_median_feeds( head_time, next_maint_time );
+      });
+      if( !(old_feed == bad->current_feed) )
+         process_median_feed_change( bad->asset_id( *this ), *bad );
+   }
+   _pending_median_feed_updates.clear();
+}
+
 void database::update_expired_feeds()
 {
    const auto head_time = head_block_time();
@@ -598,26 +616,27 @@ void database::update_maintenance_flag( bool new_maintenance_flag )
 
 void database::update_withdraw_permissions()
 {
-   auto& permit_index = get_index_type<withdraw_permission_index>().indices().get<by_expiration>();
-   while( !permit_index.empty() && permit_index.begin()->expiration <= head_block_time() )
-      remove(*permit_index.begin());
+   const auto& expired_permits = get_index_type< primary_index< withdraw_permission_index > >()
+                                    .get_secondary_index< withdraw_permission_expiration_index >();
+   while( const withdraw_permission_object* permit = expired_permits.find_expired( head_block_time() ) )
+      remove( *permit );
 }
 
 void database::clear_expired_htlcs()
 {
-   const auto& htlc_idx = get_index_type<htlc_index>().indices().get<by_expiration>();
-   while ( htlc_idx.begin() != htlc_idx.end()
-         && htlc_idx.begin()->conditions.time_lock.expiration <= head_block_time() )
+   const auto& expired_htlcs = get_index_type< primary_index< htlc_index, hashed_ids > >()
+                                  .get_secondary_index< htlc_expiration_index >();
+   while( const htlc_object* htlc_ptr = expired_htlcs.find_expired( head_block_time() ) )
    {
-      const htlc_object& obj = *htlc_idx.begin();
+      const htlc_object& obj = *htlc_ptr;
       adjust_balance( obj.transfer.from, asset(obj.transfer.amount, obj.transfer.asset_id) );
       // virtual op
       htlc_refund_operation vop( obj.id, obj.transfer.from );
-      vop.htlc_id = htlc_idx.begin()->id;
+      vop.htlc_id = obj.id;
       push_applied_operation( vop );
 
       // remove the db object
-      remove( *htlc_idx.begin() );
+      remove( obj );
    }
 }
 
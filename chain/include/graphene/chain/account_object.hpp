@@ -304,6 +304,10 @@ namespace graphene { namespace chain {
          virtual void object_removed( const object& obj ) override;
          virtual void about_to_modify( const object& before ) override;
          virtual void object_modified( const object& after  ) override;
+         virtual void objects_inserted( const vector<const object*>& objs ) override;
+         virtual bool is_deferrable()const override { return true; }
+         virtual void clear() override;
+         virtual uint64_t get_memory_usage()const override;
 
 
          /** given an account or key, map it to the set of accounts that reference it in an active or owner authority */
@@ -343,24 +347,44 @@ namespace graphene { namespace chain {
    /**
     *  @brief This secondary index will allow fast access to the balance objects
     *         that belonging to an account.
+    *
+    *  Balances are kept in a dense, owner-major table: rows are addressed directly by account instance,
+    *  and each row is a short vector of entries sorted by asset which caches the balance next to the
+    *  object pointer.  Balance lookups therefore scan a few contiguous entries instead of walking a tree,
+    *  and do not touch the primary index at all.  The cache follows the primary index through the
+    *  secondary index notifications, which are also fired when undoing.
     */
    class balances_by_account_index : public secondary_index
    {
       public:
+         struct balance_entry
+         {
+            asset_id_type                  asset_type;
+            share_type                     balance;
+            const account_balance_object*  object = nullptr;
+         };
+         /** The balances of one account, sorted by asset */
+         typedef vector< balance_entry > balance_row;
+
          virtual void object_inserted( const object& obj ) override;
          virtual void object_removed( const object& obj ) override;
          virtual void about_to_modify( const object& before ) override;
          virtual void object_modified( const object& after  ) override;
+         virtual uint64_t get_memory_usage()const override;
 
-         const map< asset_id_type, const account_balance_object* >& get_account_balances( const account_id_type& acct )const;
+         const balance_row& get_account_balances( const account_id_type& acct )const;
+         const balance_entry* find_balance( const account_id_type& acct, const asset_id_type& asset )const;
          const account_balance_object* get_account_balance( const account_id_type& acct, const asset_id_type& asset )const;
 
       private:
          static const uint8_t  bits;
          static const uint64_t mask;
 
-         /** Maps each account to its balance objects */
-         vector< vector< map< asset_id_type, const account_balance_object* > > > balances;
+         balance_row* find_row( const account_id_type& acct );
+         balance_row::iterator find_in_row( balance_row& row, const asset_id_type& asset )const;
+
+         /** Maps each account to its balances */
+         vector< vector< balance_row > > balances;
          std::stack< object_id_type > ids_being_modified;
    };
 
@@ -443,10 +467,24 @@ namespace graphene { namespace chain {
 
 }}
 
+namespace graphene { namespace db {
+   /** leaves the fields the account history plugins maintain out of the state hash */
+   template<>
+   struct state_hash_of< graphene::chain::account_statistics_object >
+   {
+      static fc::sha256 hash( const graphene::chain::account_statistics_object& o );
+   };
+} }
+
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::account_object)
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::account_balance_object)
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::account_statistics_object)
 
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::account_balance_object,
+                                   graphene::db::primary_index< graphene::chain::account_balance_index > )
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::account_statistics_object,
+                                   graphene::db::primary_index< graphene::chain::account_stats_index, 20 > )
+
 FC_REFLECT_TYPENAME( graphene::chain::account_object )
 FC_REFLECT_TYPENAME( graphene::chain::account_balance_object )
 FC_REFLECT_TYPENAME( graphene::chain::account_statistics_object )
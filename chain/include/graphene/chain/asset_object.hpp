@@ -23,7 +23,9 @@
  */
 #pragma once
 #include <graphene/chain/types.hpp>
+#include <graphene/db/copy_on_write.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/simple_index.hpp>
 #include <graphene/protocol/asset_ops.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
@@ -187,7 +189,7 @@ namespace graphene { namespace chain {
          /// Feeds published for this asset. If issuer is not committee, the keys in this map are the feed publishing
          /// accounts; otherwise, the feed publishers are the currently active committee_members and witnesses and this map
          /// should be treated as an implementation detail. The timestamp on each feed is the time it was published.
-         flat_map<account_id_type, pair<time_point_sec,price_feed>> feeds;
+         copy_on_write< flat_map<account_id_type, pair<time_point_sec,price_feed>> > feeds;
          /// This is the currently active price feed, calculated as the median of values from the currently active
          /// feeds.
          price_feed current_feed;
@@ -323,6 +325,11 @@ MAP_OBJECT_ID_TO_TYPE(graphene::chain::asset_object)
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::asset_dynamic_data_object)
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::asset_bitasset_data_object)
 
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::asset_dynamic_data_object,
+      graphene::db::primary_index< graphene::db::simple_index< graphene::chain::asset_dynamic_data_object > > )
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::asset_bitasset_data_object,
+      graphene::db::primary_index< graphene::chain::asset_bitasset_data_index, 13 > )
+
 FC_REFLECT_DERIVED( graphene::chain::asset_object, (graphene::db::object),
                     (symbol)
                     (precision)
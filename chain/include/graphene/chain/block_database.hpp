@@ -22,7 +22,11 @@
  * THE SOFTWARE.
  */
 #pragma once
+#include <atomic>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <graphene/protocol/block.hpp>
 
 #include <fc/filesystem.hpp>
@@ -31,9 +35,44 @@ namespace graphene { namespace chain {
    struct index_entry;
    using namespace graphene::protocol;
 
+   /**
+    *  Stores blocks by number in an append only blocks file plus an index file of fixed size entries.
+    *
+    *  Blocks are appended to segment files of 2^window_bits bytes, data never crosses the end of a segment.
+    *  Block databases created before segments existed keep a single blocks file.
+    *
+    *  The index and the blocks are read through read only memory mappings, blocks are unpacked straight from
+    *  the mapped pages. Any number of threads may fetch blocks concurrently without locking while one thread
+    *  stores or removes blocks.
+    *
+    *  Optionally the blocks file holds zlib compressed frames of consecutive blocks instead, see
+    *  set_compression(). Block positions in the index then refer to the uncompressed stream of all blocks,
+    *  a frames file maps them to the compressed frames, and the blocks of the frame that is not full yet are
+    *  kept uncompressed in a tail file.
+    *
+    *  With pruning enabled, see set_pruning(), only the most recent blocks are kept. The index keeps the ids of
+    *  pruned blocks, so contains() and fetch_block_id() still know them, but fetching them returns nothing and
+    *  the space they occupied is released by deleting whole segments, or by punching holes into a single
+    *  blocks file.
+    */
    class block_database 
    {
       public:
+         block_database();
+         ~block_database();
+
+         /**
+          * Stores blocks in compressed frames of blocks_per_frame blocks, 0 stores them uncompressed. This must be
+          * called before open() and only takes effect for a new block database, an existing one keeps its format.
+          */
+         void set_compression( uint32_t blocks_per_frame );
+         bool is_compressed()const { return _compressed; }
+
+         /** Keeps only the last retain_blocks blocks, 0 keeps all of them. May be called at any time. */
+         void set_pruning( uint32_t retain_blocks );
+         /** @return the number of the first block that has not been pruned */
+         uint32_t first_block_num()const;
+
          void open( const fc::path& dbdir );
          bool is_open()const;
          void flush();
@@ -51,9 +90,93 @@ namespace graphene { namespace chain {
          size_t                 blocks_current_position()const;
          size_t                 total_block_size()const;
       private:
+         struct window;
+         struct frame_entry;
+         struct frame_data;
+
+         /** the index file is mapped in chunks of 2^index_chunk_bits entries */
+         static const uint8_t  index_chunk_bits = 16;
+         static const uint32_t max_index_chunks = 1u << ( 32 - index_chunk_bits );
+         /** the blocks file is mapped in windows of 2^window_bits bytes, which are also the segment size */
+         static const uint8_t  window_bits = 30;
+         static const uint32_t max_windows = 1u << 14;
+         /** frame size used when an existing compressed block database is opened without set_compression() */
+         static const uint32_t default_blocks_per_frame = 256;
+         /**
+          * decompressed frames kept for readers, enough for every reindex worker and the p2p and API readers to
+          * keep their current frame
+          */
+         static const uint32_t frame_cache_size = 64;
+         /** blocks are pruned in batches of this many blocks */
+         static const uint32_t prune_interval = 10000;
+
+         /** copies the entry of block_num into e, @return false if there is none */
+         bool read_entry( uint32_t block_num, index_entry& e )const;
+         void write_entry( uint32_t block_num, const index_entry& e );
+         optional<signed_block> read_block( const index_entry& e )const;
+         optional<signed_block> read_compressed_block( uint64_t pos, uint32_t size )const;
+         const index_entry* map_index_chunk( uint32_t number )const;
+         const char* map_window( uint64_t number )const;
+         /** @return the size bytes at pos of the blocks file, temp receives the mapping if they cross a window */
+         const char* map_range( uint64_t pos, size_t size, std::unique_ptr<window>& temp )const;
+         void release_memory();
+
+         fc::path segment_filename( uint64_t number )const;
+         /** writes data to the end of the blocks, @return its position */
+         uint64_t append_blocks_data( const char* data, size_t size );
+         void truncate_blocks( uint64_t end );
+
+         void open_frames( const fc::path& dbdir );
+         void store_compressed( const std::vector<char>& data );
+         /** compresses the tail into a new frame at the end of the blocks file */
+         void seal_frame();
+
+         /** drops all blocks before first_block */
+         void prune( uint32_t first_block );
+
          optional<index_entry> last_index_entry()const;
+         fc::path _dbdir;
          fc::path _index_filename;
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         fc::path _blocks_filename;
+         /** only used for writing, readers go through the mappings */
+         std::fstream _blocks;
+         bool         _segmented = true;
+         uint64_t     _current_segment = 0;
+         /** segments before this one have been pruned */
+         uint64_t     _first_segment = 0;
+         /** physical end of the blocks */
+         uint64_t     _blocks_file_size = 0;
+         std::fstream _block_num_to_pos;
+
+         std::unique_ptr< std::atomic<window*>[] >       _index_windows;
+         std::atomic<uint32_t>                           _index_size;
+         /** odd while an index entry is being written, readers retry if it changed while they copied an entry */
+         std::atomic<uint64_t>                           _index_sequence;
+         std::atomic<uint64_t>                           _blocks_size;
+         std::unique_ptr< std::atomic<window*>[] >       _windows;
+         /** mappings of pruned segments, released on the next pruning run */
+         std::vector< std::unique_ptr<window> >          _retired_windows;
+         mutable std::atomic<uint64_t>                   _read_position;
+
+         /** compressed format, _blocks_size is the size of the uncompressed stream */
+         uint32_t                                        _blocks_per_frame = 0;
+         bool                                            _compressed = false;
+         fc::path                                        _frames_filename;
+         fc::path                                        _tail_filename;
+         std::fstream                                    _frames_file;
+         std::fstream                                    _tail_file;
+         uint32_t                                        _tail_blocks = 0;
+         /** guards the members below, which readers of compressed blocks share with the writer */
+         mutable std::mutex                              _frames_mutex;
+         std::vector<frame_entry>                        _frames;
+         std::atomic<uint64_t>                           _tail_begin;
+         std::vector<char>                               _tail;
+         /** recently read frames, the most recently used first */
+         mutable std::vector< std::shared_ptr<const frame_data> > _frame_cache;
+
+         uint32_t                                        _retain_blocks = 0;
+         fc::path                                        _first_block_filename;
+         /** blocks before this one have been pruned */
+         std::atomic<uint32_t>                           _first_block;
    };
 } }
@@ -113,6 +113,19 @@ namespace graphene { namespace chain {
           */
          void reindex(fc::path data_dir);
 
+         /**
+          * @brief Makes reindex() verify the state hash after applying the given block
+          *
+          * Replaying fails if the state hash after block_num differs from the expected hash, which should be
+          * taken from a trusted node with @ref object_database::get_state_hash at the same block. It also fails
+          * if the replay does not apply block_num, because the block is already in the state, beyond the block
+          * log or behind a gap in it. The check applies to the next replay only.
+          */
+         void set_replay_state_check( uint32_t block_num, const fc::sha256& expected_hash );
+
+         /** Limits the memory used by the blocks read ahead of the apply loop during reindex */
+         void set_reindex_memory_budget( uint64_t bytes ) { _reindex_memory_budget = bytes; }
+
          /**
           * @brief wipe Delete database from disk, and potentially the raw chain as well.
           * @param include_blocks If true, delete the raw chain as well as the database.
@@ -133,6 +146,8 @@ namespace graphene { namespace chain {
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
+         /** @return the number of the oldest block that can be fetched, older ones have been pruned */
+         uint32_t                   get_first_stored_block_num()const;
          const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
@@ -362,6 +377,18 @@ namespace graphene { namespace chain {
          void cancel_settle_order(const force_settlement_object& order, bool create_virtual_op = true);
          void cancel_limit_order(const limit_order_object& order, bool create_virtual_op = true, bool skip_cancel_fee = false);
          void revive_bitasset( const asset_object& bitasset );
+         /**
+          * @brief Processes a change of the median feed of a bitasset
+          *
+          * Revives the asset if it was globally settled and the new feed allows it, then checks margin calls.
+          */
+         void process_median_feed_change( const asset_object& mia, const asset_bitasset_data_object& bitasset );
+         /**
+          * @brief Defers updating the median feed of a bitasset to the end of the block
+          *
+          * After core-batch-feeds hard fork the median feed is updated once per block for all feeds published in it.
+          */
+         void defer_median_feed_update( const asset_bitasset_data_object& bitasset );
          void cancel_bid(const collateral_bid_object& bid, bool create_virtual_op = true);
          void execute_bid( const collateral_bid_object& bid, share_type debt_covered, share_type collateral_from_fund, const price_feed& current_feed );
 
@@ -415,6 +442,11 @@ namespace graphene { namespace chain {
 
          bool check_call_orders( const asset_object& mia, bool enable_black_swan = true, bool for_new_limit_order = false,
                                  const asset_bitasset_data_object* bitasset_ptr = nullptr );
+         /// Cancels the limit orders and executes the force settlements that are due at the head block time
+         void clear_expired_orders();
+         /// @return the call order with the least collateralization of a debt asset, or nullptr if it has none
+         const call_order_object* find_least_collateralized_call( const asset_object& mia,
+                                                                  const asset_bitasset_data_object& bitasset )const;
 
          // helpers to fill_order
          void pay_order( const account_object& receiver, const asset& receives, const asset& pays );
@@ -444,6 +476,11 @@ namespace graphene { namespace chain {
          /// Enable or disable tracking of votes of standby witnesses and committee members
          inline void enable_standby_votes_tracking(bool enable)  { _track_standby_votes = enable; }
 
+         /** Stores blocks in compressed frames when the block database is created, must be called before open() */
+         void set_block_log_compression( uint32_t blocks_per_frame ) { _block_id_to_block.set_compression( blocks_per_frame ); }
+         /** Keeps only the last retain_blocks blocks in the block database, 0 keeps all of them */
+         void set_block_log_pruning( uint32_t retain_blocks );
+
          /** Precomputes digests, signatures and operation validations depending
           *  on skip flags. "Expensive" computations may be done in a parallel
           *  thread.
@@ -466,6 +503,8 @@ namespace graphene { namespace chain {
    private:
          template<typename Trx>
          void _precompute_parallel( const Trx* trx, const size_t count, const uint32_t skip )const;
+         /** Does what precompute_parallel() does for a block, sequentially in the calling thread */
+         void precompute_block( const signed_block& block, const uint32_t skip )const;
 
    protected:
          //Mark pop_undo() as protected -- we do not want outside calling pop_undo(); it should call pop_block() instead
@@ -478,6 +517,9 @@ namespace graphene { namespace chain {
          optional<undo_database::session>       _pending_tx_session;
          vector< unique_ptr<op_evaluator> >     _operation_evaluators;
 
+         /** called by reindex() after applying the block of _replay_state_check */
+         void verify_replay_state()const;
+
          template<class Index>
          vector<std::reference_wrapper<const typename Index::object_type>> sort_votable_objects(size_t count)const;
 
@@ -511,13 +553,13 @@ namespace graphene { namespace chain {
          void update_last_irreversible_block();
          void clear_expired_transactions();
          void clear_expired_proposals();
-         void clear_expired_orders();
          void update_expired_feeds();
          void update_core_exchange_rates();
          void update_maintenance_flag( bool new_maintenance_flag );
          void update_withdraw_permissions();
          bool check_for_blackswan( const asset_object& mia, bool enable_black_swan = true,
                                    const asset_bitasset_data_object* bitasset_ptr = nullptr );
+         void update_pending_median_feeds();
          void clear_expired_htlcs();
 
          ///Steps performed only at maintenance intervals
@@ -574,6 +616,10 @@ namespace graphene { namespace chain {
 
          flat_map<uint32_t,block_id_type>  _checkpoints;
 
+         /** block number and expected state hash verified by reindex(), if set */
+         optional< std::pair<uint32_t,fc::sha256> > _replay_state_check;
+         uint64_t                                   _reindex_memory_budget = uint64_t(1) << 30;
+
          node_property_object              _node_property_object;
 
          /// Whether to update votes of standby witnesses and committee members when performing chain maintenance.
@@ -595,6 +641,9 @@ namespace graphene { namespace chain {
          /// Tracks assets affected by msc-core issue #453 before hard fork #615 in one block
          flat_set<asset_id_type>           _issue_453_affected_assets;
 
+         /// Bitassets that got new feeds in one block, their median feeds are updated at the end of the block
+         flat_set<asset_bitasset_data_id_type>  _pending_median_feed_updates;
+
          /// Pointers to core asset object and global objects who will have immutable addresses after created
          ///@{
          const asset_object*                    _p_core_asset_obj          = nullptr;
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <graphene/protocol/htlc.hpp>
+#include <graphene/db/expiration_wheel.hpp>
 #include <graphene/db/generic_index.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
@@ -85,18 +86,12 @@ namespace graphene { namespace chain {
    };
 
    struct by_from_id;
-   struct by_expiration;
    struct by_to_id;
    typedef multi_index_container<
          htlc_object,
          indexed_by<
             ordered_unique< tag< by_id >, member< object, object_id_type, &object::id > >,
 
-            ordered_unique< tag< by_expiration >, 
-                  composite_key< htlc_object,
-                  htlc_object::timelock_extractor,
-                  member< object, object_id_type, &object::id > > >,
-
             ordered_unique< tag< by_from_id >,
                   composite_key< htlc_object, 
                   htlc_object::from_extractor,
@@ -112,6 +107,9 @@ namespace graphene { namespace chain {
 
    typedef generic_index< htlc_object, htlc_object_index_type > htlc_index;
 
+   /// Finds the HTLCs whose time lock expired
+   typedef expiration_wheel< htlc_object, htlc_object::timelock_extractor > htlc_expiration_index;
+
 } } // namespace graphene::chain
 
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::htlc_object)
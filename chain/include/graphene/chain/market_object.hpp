@@ -24,11 +24,14 @@
 #pragma once
 
 #include <graphene/chain/types.hpp>
+#include <graphene/db/expiration_wheel.hpp>
 #include <graphene/db/generic_index.hpp>
 #include <graphene/protocol/asset.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
 
+#include <deque>
+
 namespace graphene { namespace chain {
 
 using namespace graphene::db;
@@ -68,18 +71,11 @@ class limit_order_object : public abstract_object<limit_order_object>
 };
 
 struct by_price;
-struct by_expiration;
 struct by_account;
 typedef multi_index_container<
    limit_order_object,
    indexed_by<
       ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
-      ordered_unique< tag<by_expiration>,
-         composite_key< limit_order_object,
-            member< limit_order_object, time_point_sec, &limit_order_object::expiration>,
-            member< object, object_id_type, &object::id>
-         >
-      >,
       ordered_unique< tag<by_price>,
          composite_key< limit_order_object,
             member< limit_order_object, price, &limit_order_object::sell_price>,
@@ -100,6 +96,46 @@ typedef multi_index_container<
 
 typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
 
+/// Finds the expired limit orders
+typedef expiration_wheel< limit_order_object,
+                          member< limit_order_object, time_point_sec, &limit_order_object::expiration > >
+        limit_order_expiration_index;
+
+/**
+ *  @brief Order books of the limit orders, one per market and direction
+ *
+ *  The by_price index of @ref limit_order_index holds the orders of all markets, so every lookup pays for a tree
+ *  as deep as the whole order set and walks nodes of unrelated markets. This index keeps a separate book for
+ *  every (sell asset, receive asset) pair instead. A book is a contiguous array of price levels, and each level
+ *  is a queue of the orders at that price in id order, which is the order by_price uses for equal prices.
+ *  Levels are sorted from the worst to the best price, so that consuming the best level pops the back.
+ *
+ *  The sell price of a limit order never changes, so modifications need no bookkeeping.
+ */
+class limit_order_book_index : public secondary_index
+{
+   public:
+      struct price_level
+      {
+         price                                  sell_price;
+         std::deque<const limit_order_object*>  orders; ///< sorted by id
+      };
+      /** The levels of one market direction, sorted from the worst to the best price */
+      typedef vector<price_level> book_side;
+
+      virtual void object_inserted( const object& obj ) override;
+      virtual void object_removed( const object& obj ) override;
+      virtual uint64_t get_memory_usage()const override;
+
+      /** @return the orders selling sell_asset for receive_asset, or nullptr if there are none */
+      const book_side* find_book( asset_id_type sell_asset, asset_id_type receive_asset )const;
+      /** @return the order with the highest sell price, and the lowest id among those, or nullptr */
+      const limit_order_object* get_best_order( asset_id_type sell_asset, asset_id_type receive_asset )const;
+
+   private:
+      flat_map< pair<asset_id_type,asset_id_type>, book_side > _books;
+};
+
 /**
  * @class call_order_object
  * @brief tracks debt and call price information
@@ -268,6 +304,37 @@ typedef generic_index<call_order_object, call_order_multi_index_type>
 typedef generic_index<force_settlement_object, force_settlement_object_multi_index_type>   force_settlement_index;
 typedef generic_index<collateral_bid_object, collateral_bid_object_multi_index_type>       collateral_bid_index;
 
+/**
+ *  @brief Remembers the least collateralized call order of every debt asset
+ *
+ *  check_call_orders() runs on every feed update, and usually finds that even the least collateralized position
+ *  is safe. This index lets it find that position in constant time instead of searching by_collateral of
+ *  @ref call_order_index. An entry follows inserted and modified call orders that become the least collateralized
+ *  one, and is invalidated when its call order is removed or modified, since then any other call order can be the
+ *  least collateralized one. Invalid entries are looked up again in by_collateral on demand.
+ */
+class call_order_trigger_index : public secondary_index
+{
+   public:
+      virtual void object_inserted( const object& obj ) override;
+      virtual void object_removed( const object& obj ) override;
+      virtual void object_modified( const object& after ) override;
+
+      /**
+       * @param least set to the least collateralized call order of debt_asset, or nullptr if it has none
+       * @return false if the entry is not known
+       */
+      bool find_least_collateralized( asset_id_type debt_asset, const call_order_object*& least )const;
+      /** Caches the result of a by_collateral lookup */
+      void set_least_collateralized( asset_id_type debt_asset, const call_order_object* least )const;
+
+   private:
+      /** filled lazily by lookups, hence mutable */
+      mutable flat_map< asset_id_type, const call_order_object* > _least_collateralized;
+
+      void update( const call_order_object& call );
+};
+
 } } // graphene::chain
 
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::limit_order_object)
@@ -275,6 +342,14 @@ MAP_OBJECT_ID_TO_TYPE(graphene::chain::call_order_object)
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::force_settlement_object)
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::collateral_bid_object)
 
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::limit_order_object,
+                                   graphene::db::primary_index< graphene::chain::limit_order_index,
+                                                                graphene::db::hashed_ids > )
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::call_order_object,
+                                   graphene::db::primary_index< graphene::chain::call_order_index > )
+GRAPHENE_DB_DECLARE_PRIMARY_INDEX( graphene::chain::force_settlement_object,
+                                   graphene::db::primary_index< graphene::chain::force_settlement_index > )
+
 FC_REFLECT_TYPENAME( graphene::chain::limit_order_object )
 FC_REFLECT_TYPENAME( graphene::chain::call_order_object )
 FC_REFLECT_TYPENAME( graphene::chain::force_settlement_object )
@@ -25,6 +25,7 @@
 
 #include <graphene/protocol/types.hpp>
 #include <graphene/protocol/transaction.hpp>
+#include <graphene/db/expiration_wheel.hpp>
 #include <graphene/db/generic_index.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
@@ -86,22 +87,19 @@ class required_approval_index : public secondary_index
       flat_set<account_id_type> available_owner_before_modify;
 };
 
-struct by_expiration{};
 typedef boost::multi_index_container<
    proposal_object,
    indexed_by<
-      ordered_unique< tag< by_id >, member< object, object_id_type, &object::id > >,
-      //ordered_non_unique< tag< by_expiration >, member< proposal_object, time_point_sec, &proposal_object::expiration_time > >
-      ordered_unique<tag<by_expiration>,
-         composite_key<proposal_object,
-            member<proposal_object, time_point_sec, &proposal_object::expiration_time>,
-            member< object, object_id_type, &object::id >
-         >
-      >
+      ordered_unique< tag< by_id >, member< object, object_id_type, &object::id > >
    >
 > proposal_multi_index_container;
 typedef generic_index<proposal_object, proposal_multi_index_container> proposal_index;
 
+/// Finds the expired proposals
+typedef expiration_wheel< proposal_object,
+                          member< proposal_object, time_point_sec, &proposal_object::expiration_time > >
+        proposal_expiration_index;
+
 } } // graphene::chain
 
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::proposal_object)
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <graphene/protocol/asset.hpp>
+#include <graphene/db/expiration_wheel.hpp>
 #include <graphene/db/generic_index.hpp>
 
 #include <boost/multi_index/composite_key.hpp>
@@ -85,7 +86,6 @@ namespace graphene { namespace chain {
 
    struct by_from;
    struct by_authorized;
-   struct by_expiration;
 
    typedef multi_index_container<
       withdraw_permission_object,
@@ -102,18 +102,17 @@ namespace graphene { namespace chain {
                member<withdraw_permission_object, account_id_type, &withdraw_permission_object::authorized_account>,
                member< object, object_id_type, &object::id >
             >
-         >,
-         ordered_unique< tag<by_expiration>,
-            composite_key< withdraw_permission_object,
-               member<withdraw_permission_object, time_point_sec, &withdraw_permission_object::expiration>,
-               member< object, object_id_type, &object::id >
-            >
          >
       >
    > withdraw_permission_object_multi_index_type;
 
    typedef generic_index<withdraw_permission_object, withdraw_permission_object_multi_index_type> withdraw_permission_index;
 
+   /// Finds the expired withdraw permissions
+   typedef expiration_wheel< withdraw_permission_object,
+                             member< withdraw_permission_object, time_point_sec, &withdraw_permission_object::expiration > >
+           withdraw_permission_expiration_index;
+
 
 } } // graphene::chain
 
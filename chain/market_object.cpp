@@ -303,6 +303,129 @@ share_type call_order_object::get_max_debt_to_cover( price match_price,
 
 } FC_CAPTURE_AND_RETHROW( (*this)(feed_price)(match_price)(maintenance_collateral_ratio) ) }
 
+void call_order_trigger_index::update( const call_order_object& call )
+{
+   auto itr = _least_collateralized.find( call.debt_type() );
+   if( itr == _least_collateralized.end() )
+      return;
+   if( itr->second == &call )
+      _least_collateralized.erase( itr ); // may have become better collateralized than others
+   else if( itr->second == nullptr || call.collateralization() < itr->second->collateralization() )
+      itr->second = &call;
+}
+
+void call_order_trigger_index::object_inserted( const object& obj )
+{
+   update( static_cast<const call_order_object&>( obj ) );
+}
+
+void call_order_trigger_index::object_removed( const object& obj )
+{
+   const auto& call = static_cast<const call_order_object&>( obj );
+   auto itr = _least_collateralized.find( call.debt_type() );
+   if( itr != _least_collateralized.end() && itr->second == &call )
+      _least_collateralized.erase( itr );
+}
+
+void call_order_trigger_index::object_modified( const object& after )
+{
+   update( static_cast<const call_order_object&>( after ) );
+}
+
+bool call_order_trigger_index::find_least_collateralized( asset_id_type debt_asset,
+                                                          const call_order_object*& least )const
+{
+   auto itr = _least_collateralized.find( debt_asset );
+   if( itr == _least_collateralized.end() )
+      return false;
+   least = itr->second;
+   return true;
+}
+
+void call_order_trigger_index::set_least_collateralized( asset_id_type debt_asset,
+                                                         const call_order_object* least )const
+{
+   _least_collateralized[debt_asset] = least;
+}
+
+void limit_order_book_index::object_inserted( const object& obj )
+{
+   const auto& order = static_cast<const limit_order_object&>( obj );
+   auto& side = _books[ std::make_pair( order.sell_asset_id(), order.receive_asset_id() ) ];
+   auto level = std::lower_bound( side.begin(), side.end(), order.sell_price,
+                                  []( const price_level& l, const price& p ) { return l.sell_price < p; } );
+   if( level == side.end() || level->sell_price != order.sell_price )
+   {
+      level = side.insert( level, price_level() );
+      level->sell_price = order.sell_price;
+   }
+   // new orders have the highest id, only undo reinserts older orders
+   if( level->orders.empty() || level->orders.back()->id < order.id )
+      level->orders.push_back( &order );
+   else
+      level->orders.insert( std::upper_bound( level->orders.begin(), level->orders.end(), order.id,
+                                              []( const object_id_type& id, const limit_order_object* o ) {
+                                                 return id < o->id;
+                                              } ),
+                            &order );
+}
+
+void limit_order_book_index::object_removed( const object& obj )
+{
+   const auto& order = static_cast<const limit_order_object&>( obj );
+   auto book = _books.find( std::make_pair( order.sell_asset_id(), order.receive_asset_id() ) );
+   if( book == _books.end() ) return;
+   auto& side = book->second;
+   auto level = std::lower_bound( side.begin(), side.end(), order.sell_price,
+                                  []( const price_level& l, const price& p ) { return l.sell_price < p; } );
+   if( level == side.end() || level->sell_price != order.sell_price ) return;
+
+   // filled orders are usually the first of the level
+   if( !level->orders.empty() && level->orders.front() == &order )
+      level->orders.pop_front();
+   else
+   {
+      auto itr = std::lower_bound( level->orders.begin(), level->orders.end(), order.id,
+                                   []( const limit_order_object* o, const object_id_type& id ) {
+                                      return o->id < id;
+                                   } );
+      if( itr == level->orders.end() || *itr != &order ) return;
+      level->orders.erase( itr );
+   }
+
+   if( level->orders.empty() )
+      side.erase( level );
+   if( side.empty() )
+      _books.erase( book );
+}
+
+uint64_t limit_order_book_index::get_memory_usage()const
+{
+   uint64_t result = _books.capacity() * sizeof( *_books.begin() );
+   for( const auto& book : _books )
+   {
+      result += book.second.capacity() * sizeof( price_level );
+      for( const auto& level : book.second )
+         result += level.orders.size() * sizeof( const limit_order_object* );
+   }
+   return result;
+}
+
+const limit_order_book_index::book_side* limit_order_book_index::find_book( asset_id_type sell_asset,
+                                                                          asset_id_type receive_asset )const
+{
+   auto book = _books.find( std::make_pair( sell_asset, receive_asset ) );
+   return book == _books.end() ? nullptr : &book->second;
+}
+
+const limit_order_object* limit_order_book_index::get_best_order( asset_id_type sell_asset,
+                                                                 asset_id_type receive_asset )const
+{
+   const book_side* side = find_book( sell_asset, receive_asset );
+   // empty levels and books are erased
+   return side ? side->back().orders.front() : nullptr;
+}
+
 FC_REFLECT_DERIVED_NO_TYPENAME( graphene::chain::limit_order_object,
                     (graphene::db::object),
                     (expiration)(seller)(for_sale)(sell_price)(deferred_fee)(deferred_paid_fee)
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/io/raw.hpp>
+#include <fc/variant.hpp>
+
+#include <memory>
+#include <utility>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class copy_on_write
+    * @brief Holds a container member of an object which is shared between copies of the object until one of
+    * them modifies it
+    *
+    * The undo database copies an object before its first modification in a block. For objects that carry
+    * big containers, such as the price feeds of a bitasset, most modifications do not touch the container,
+    * so sharing it makes the undo copy cheap. Any non-const access detaches the container first, so
+    * iterators obtained through a const reference must not be passed to a non-const member afterwards.
+    *
+    * The wrapper forwards the usual container interface and is serialized exactly like the container.
+    */
+   template<typename T>
+   class copy_on_write
+   {
+      public:
+         typedef T                                      container_type;
+         typedef typename T::value_type                 value_type;
+         typedef typename T::size_type                  size_type;
+         typedef typename T::iterator                   iterator;
+         typedef typename T::const_iterator             const_iterator;
+         typedef typename T::reverse_iterator           reverse_iterator;
+         typedef typename T::const_reverse_iterator     const_reverse_iterator;
+
+         copy_on_write() : _value( std::make_shared<T>() ) {}
+         copy_on_write( const T& value ) : _value( std::make_shared<T>( value ) ) {}
+         copy_on_write( T&& value ) : _value( std::make_shared<T>( std::move(value) ) ) {}
+
+         copy_on_write& operator=( const T& value ) { _value = std::make_shared<T>( value ); return *this; }
+         copy_on_write& operator=( T&& value ) { _value = std::make_shared<T>( std::move(value) ); return *this; }
+
+         const T& get()const { return *_value; }
+         operator const T&()const { return *_value; }
+
+         /** @return the container for modification, copying it first if it is shared */
+         T& get_mutable()
+         {
+            if( _value.use_count() > 1 )
+               _value = std::make_shared<T>( *_value );
+            return *_value;
+         }
+
+         bool      empty()const { return _value->empty(); }
+         size_type size()const  { return _value->size(); }
+
+         const_iterator         begin()const  { return _value->begin(); }
+         const_iterator         end()const    { return _value->end(); }
+         const_reverse_iterator rbegin()const { return _value->rbegin(); }
+         const_reverse_iterator rend()const   { return _value->rend(); }
+         iterator               begin()       { return get_mutable().begin(); }
+         iterator               end()         { return get_mutable().end(); }
+         reverse_iterator       rbegin()      { return get_mutable().rbegin(); }
+         reverse_iterator       rend()        { return get_mutable().rend(); }
+
+         template<typename Key>
+         const_iterator find( const Key& key )const { return _value->find( key ); }
+         template<typename Key>
+         iterator       find( const Key& key )      { return get_mutable().find( key ); }
+         template<typename Key>
+         size_type      count( const Key& key )const { return _value->count( key ); }
+
+         template<typename Key>
+         typename T::mapped_type& operator[]( const Key& key ) { return get_mutable()[key]; }
+
+         template<typename... Args>
+         auto insert( Args&&... args ) -> decltype( std::declval<T&>().insert( std::forward<Args>(args)... ) )
+         { return get_mutable().insert( std::forward<Args>(args)... ); }
+         template<typename... Args>
+         auto emplace( Args&&... args ) -> decltype( std::declval<T&>().emplace( std::forward<Args>(args)... ) )
+         { return get_mutable().emplace( std::forward<Args>(args)... ); }
+         template<typename... Args>
+         auto erase( Args&&... args ) -> decltype( std::declval<T&>().erase( std::forward<Args>(args)... ) )
+         { return get_mutable().erase( std::forward<Args>(args)... ); }
+         void clear() { get_mutable().clear(); }
+
+         friend bool operator==( const copy_on_write& a, const copy_on_write& b ) { return a.get() == b.get(); }
+         friend bool operator!=( const copy_on_write& a, const copy_on_write& b ) { return a.get() != b.get(); }
+
+      private:
+         std::shared_ptr<T> _value;
+   };
+
+} } // graphene::db
+
+namespace fc {
+
+template<typename T>
+void to_variant( const graphene::db::copy_on_write<T>& value, fc::variant& var, uint32_t max_depth )
+{
+   to_variant( value.get(), var, max_depth );
+}
+
+template<typename T>
+void from_variant( const fc::variant& var, graphene::db::copy_on_write<T>& value, uint32_t max_depth )
+{
+   T tmp;
+   from_variant( var, tmp, max_depth );
+   value = std::move(tmp);
+}
+
+namespace raw {
+
+template<typename Stream, typename T>
+void pack( Stream& stream, const graphene::db::copy_on_write<T>& value, uint32_t _max_depth=FC_PACK_MAX_DEPTH )
+{
+   fc::raw::pack( stream, value.get(), _max_depth );
+}
+
+template<typename Stream, typename T>
+void unpack( Stream& stream, graphene::db::copy_on_write<T>& value, uint32_t _max_depth=FC_PACK_MAX_DEPTH )
+{
+   T tmp;
+   fc::raw::unpack( stream, tmp, _max_depth );
+   value = std::move(tmp);
+}
+
+} // namespace raw
+
+template<typename T> struct get_typename< graphene::db::copy_on_write<T> >
+{
+   static const char* name()
+   {
+      return fc::get_typename<T>::name();
+   }
+};
+
+} // namespace fc
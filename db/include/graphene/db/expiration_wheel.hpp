@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+#include <graphene/db/flat_id_map.hpp>
+
+#include <fc/time.hpp>
+
+#include <array>
+#include <set>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class expiration_wheel
+    * @brief A secondary index which finds the expired objects of its primary index
+    *
+    * Objects are kept in a hierarchical timing wheel of 6 levels with 64 slots each. A slot of level l holds the
+    * objects expiring within a range of 64^l seconds, the ranges of a level's slots follow each other and the
+    * next level covers the time after them. Adding or removing an object costs constant time. When time
+    * advances, the slots of the higher levels are cascaded down as their ranges begin, and the objects of the
+    * passed seconds move to a small ordered set of due objects. Only due objects are ever sorted, so the many
+    * objects removed before they expire never pay for an ordered index.
+    *
+    * Due objects are returned by expiration and then by id, which is the order of the by_expiration indexes this
+    * replaces. Time may go back when blocks are popped, objects added then which are already due go directly to
+    * the due set.
+    *
+    * @tparam ExpirationOf a key extractor returning the fc::time_point_sec at which an Object expires
+    */
+   template<typename Object, typename ExpirationOf>
+   class expiration_wheel : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override
+         {
+            const Object& o = static_cast<const Object&>( obj );
+            place( entry{ ExpirationOf()( o ).sec_since_epoch(), o.id, &o } );
+         }
+
+         virtual void object_removed( const object& obj ) override
+         {
+            erase( obj.id );
+         }
+
+         virtual void object_modified( const object& after ) override
+         {
+            const Object& o = static_cast<const Object&>( after );
+            const uint64_t expiration = ExpirationOf()( o ).sec_since_epoch();
+            auto itr = _positions.find( o.id );
+            if( itr != _positions.end() && itr->second.expiration == expiration )
+               return;
+            erase( o.id );
+            place( entry{ expiration, o.id, &o } );
+         }
+
+         virtual uint64_t get_memory_usage()const override
+         {
+            uint64_t result = _positions.capacity() * sizeof( std::pair<object_id_type, position> )
+                              + _due.size() * ( sizeof( entry ) + 4 * sizeof( void* ) );
+            for( const auto& level : _wheel )
+               for( const auto& slot : level )
+                  result += slot.capacity() * sizeof( entry );
+            return result;
+         }
+
+         /**
+          * @return the object that expires first, the one with the lowest id among those, if it expires at or
+          *         before now, nullptr otherwise
+          */
+         const Object* find_expired( fc::time_point_sec now )const
+         {
+            advance( now.sec_since_epoch() );
+            if( _due.empty() || _due.begin()->expiration > now.sec_since_epoch() )
+               return nullptr;
+            return _due.begin()->obj;
+         }
+
+      private:
+         static const uint32_t level_bits      = 6;
+         static const uint64_t slots_per_level = uint64_t(1) << level_bits;
+         static const uint32_t levels          = 6;  ///< 64^6 seconds cover every time_point_sec
+         static const uint8_t  due_level       = levels;
+
+         struct entry
+         {
+            uint64_t        expiration;
+            object_id_type  id;
+            const Object*   obj;
+
+            friend bool operator<( const entry& a, const entry& b )
+            {
+               return a.expiration < b.expiration || ( a.expiration == b.expiration && a.id < b.id );
+            }
+         };
+
+         struct position
+         {
+            uint64_t expiration;
+            uint32_t index;  ///< in the slot
+            uint8_t  level;  ///< due_level if the object is in the due set
+            uint8_t  slot;
+         };
+
+         void place( const entry& e )const
+         {
+            if( e.expiration <= _now )
+            {
+               _due.insert( e );
+               _positions[e.id] = position{ e.expiration, 0, due_level, 0 };
+               return;
+            }
+            // the lowest level whose slot ranges, starting at the current one, reach the expiration
+            uint32_t level = 0;
+            while( level + 1 < levels
+                   && ( e.expiration >> ( level_bits * ( level + 1 ) ) ) != ( _now >> ( level_bits * ( level + 1 ) ) ) )
+               ++level;
+            const uint8_t slot = ( e.expiration >> ( level_bits * level ) ) & ( slots_per_level - 1 );
+            auto& bucket = _wheel[level][slot];
+            _positions[e.id] = position{ e.expiration, uint32_t( bucket.size() ), uint8_t( level ), slot };
+            bucket.push_back( e );
+            ++_level_size[level];
+         }
+
+         void erase( object_id_type id )const
+         {
+            auto itr = _positions.find( id );
+            if( itr == _positions.end() )
+               return;
+            const position pos = itr->second;
+            _positions.erase( id );
+            if( pos.level == due_level )
+            {
+               _due.erase( entry{ pos.expiration, id, nullptr } );
+               return;
+            }
+            auto& bucket = _wheel[pos.level][pos.slot];
+            if( pos.index + 1 != bucket.size() )
+            {
+               bucket[pos.index] = bucket.back();
+               _positions.find( bucket[pos.index].id )->second.index = pos.index;
+            }
+            bucket.pop_back();
+            --_level_size[pos.level];
+         }
+
+         void advance( uint64_t now )const
+         {
+            while( _now < now )
+            {
+               // if the lower levels are empty nothing happens before the next slot of the lowest used level begins
+               uint32_t level = 0;
+               while( level < levels && _level_size[level] == 0 )
+                  ++level;
+               if( level == levels )
+               {
+                  _now = now;
+                  return;
+               }
+               if( level > 0 )
+               {
+                  const uint64_t span = uint64_t(1) << ( level_bits * level );
+                  const uint64_t next = ( _now / span + 1 ) * span;
+                  if( next > now )
+                  {
+                     _now = now;
+                     return;
+                  }
+                  _now = next - 1;
+               }
+               tick();
+            }
+         }
+
+         void tick()const
+         {
+            ++_now;
+            // cascade the slots whose range begins now, higher levels first, so an object can move down
+            // several levels at once
+            for( uint32_t level = levels - 1; level > 0; --level )
+            {
+               if( _now & ( ( uint64_t(1) << ( level_bits * level ) ) - 1 ) )
+                  continue;
+               auto& bucket = _wheel[level][ ( _now >> ( level_bits * level ) ) & ( slots_per_level - 1 ) ];
+               if( bucket.empty() )
+                  continue;
+               std::vector<entry> cascaded;
+               cascaded.swap( bucket );
+               _level_size[level] -= cascaded.size();
+               for( const entry& e : cascaded )
+                  place( e );
+            }
+            auto& bucket = _wheel[0][ _now & ( slots_per_level - 1 ) ];
+            _level_size[0] -= bucket.size();
+            for( const entry& e : bucket )
+            {
+               _due.insert( e );
+               _positions[e.id] = position{ e.expiration, 0, due_level, 0 };
+            }
+            bucket.clear();
+         }
+
+         /// the wheel is advanced lazily by lookups, hence mutable
+         mutable std::array< std::array< std::vector<entry>, slots_per_level >, levels > _wheel;
+         mutable std::array< size_t, levels >                                         _level_size{};
+         mutable std::set<entry>                                                      _due;
+         mutable flat_id_map<position>                                                _positions;
+         /// every object expiring at or before this second is in the due set
+         mutable uint64_t                                                             _now = 0;
+   };
+
+} } // graphene::db
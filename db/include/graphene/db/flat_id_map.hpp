@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/protocol/object_id.hpp>
+
+#include <utility>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class flat_id_map
+    * @brief An open addressing hash map keyed by object id
+    *
+    * All entries are kept in one contiguous array, collisions are resolved by linear probing and erase
+    * shifts the following entries back so that no tombstones are needed. Inserting or erasing invalidates
+    * iterators and references. This is meant for the bookkeeping of the undo database and for id lookup
+    * tables, where the per-node allocations of unordered_map are a significant cost.
+    */
+   template<typename Value>
+   class flat_id_map
+   {
+      public:
+         typedef std::pair<object_id_type, Value> value_type;
+
+         template<typename Slot>
+         class basic_iterator
+         {
+            public:
+               basic_iterator( Slot* pos, Slot* end ):_pos(pos),_end(end) { skip_empty(); }
+
+               Slot& operator*()const  { return *_pos; }
+               Slot* operator->()const { return _pos; }
+               basic_iterator& operator++() { ++_pos; skip_empty(); return *this; }
+
+               friend bool operator==( const basic_iterator& a, const basic_iterator& b ) { return a._pos == b._pos; }
+               friend bool operator!=( const basic_iterator& a, const basic_iterator& b ) { return a._pos != b._pos; }
+
+            private:
+               void skip_empty() { while( _pos != _end && _pos->first.number == empty_key ) ++_pos; }
+
+               Slot* _pos;
+               Slot* _end;
+         };
+         typedef basic_iterator<value_type>       iterator;
+         typedef basic_iterator<const value_type> const_iterator;
+
+         flat_id_map() = default;
+         flat_id_map( const flat_id_map& ) = delete;
+         flat_id_map& operator=( const flat_id_map& ) = delete;
+         flat_id_map( flat_id_map&& other )
+         :_slots( std::move(other._slots) ),_mask(other._mask),_size(other._size)
+         {
+            other.clear();
+         }
+         flat_id_map& operator=( flat_id_map&& other )
+         {
+            if( this == &other ) return *this;
+            _slots = std::move(other._slots);
+            _mask  = other._mask;
+            _size  = other._size;
+            other.clear();
+            return *this;
+         }
+
+         size_t size()const  { return _size; }
+         /** @return the number of slots currently allocated */
+         size_t capacity()const { return _slots.size(); }
+         bool   empty()const { return _size == 0; }
+
+         iterator       begin()       { return iterator( _slots.data(), _slots.data() + _slots.size() ); }
+         iterator       end()         { return iterator( _slots.data() + _slots.size(), _slots.data() + _slots.size() ); }
+         const_iterator begin()const  { return const_iterator( _slots.data(), _slots.data() + _slots.size() ); }
+         const_iterator end()const    { return const_iterator( _slots.data() + _slots.size(), _slots.data() + _slots.size() ); }
+
+         iterator find( object_id_type id )
+         {
+            const size_t pos = locate( id );
+            return pos == npos ? end() : iterator( _slots.data() + pos, _slots.data() + _slots.size() );
+         }
+         const_iterator find( object_id_type id )const
+         {
+            const size_t pos = locate( id );
+            return pos == npos ? end() : const_iterator( _slots.data() + pos, _slots.data() + _slots.size() );
+         }
+         size_t count( object_id_type id )const { return locate( id ) == npos ? 0 : 1; }
+
+         /** inserts (id, value) unless id is present already, like std::unordered_map::emplace */
+         std::pair<iterator,bool> emplace( object_id_type id, Value value )
+         {
+            reserve( _size + 1 );
+            for( size_t i = bucket( id ); ; i = ( i + 1 ) & _mask )
+            {
+               if( _slots[i].first == id )
+                  return std::make_pair( iterator( _slots.data() + i, _slots.data() + _slots.size() ), false );
+               if( _slots[i].first.number == empty_key )
+               {
+                  _slots[i].first  = id;
+                  _slots[i].second = std::move( value );
+                  ++_size;
+                  return std::make_pair( iterator( _slots.data() + i, _slots.data() + _slots.size() ), true );
+               }
+            }
+         }
+
+         Value& operator[]( object_id_type id ) { return emplace( id, Value() ).first->second; }
+
+         size_t erase( object_id_type id )
+         {
+            size_t hole = locate( id );
+            if( hole == npos ) return 0;
+            // backward shift: move every following entry whose home bucket is not between hole and itself
+            for( size_t i = ( hole + 1 ) & _mask; _slots[i].first.number != empty_key; i = ( i + 1 ) & _mask )
+            {
+               const size_t home = bucket( _slots[i].first );
+               const bool stays = hole <= i ? ( hole < home && home <= i ) : ( hole < home || home <= i );
+               if( stays ) continue;
+               _slots[hole] = std::move( _slots[i] );
+               hole = i;
+            }
+            _slots[hole].first.number = empty_key;
+            _slots[hole].second = Value();
+            --_size;
+            return 1;
+         }
+
+         void clear()
+         {
+            _slots.clear();
+            _mask = 0;
+            _size = 0;
+         }
+
+         /** makes room for count entries without exceeding the maximum load factor */
+         void reserve( size_t count )
+         {
+            if( count * 4 <= _slots.size() * 3 ) return;
+            size_t capacity = _slots.empty() ? min_capacity : _slots.size();
+            while( count * 4 > capacity * 3 ) capacity *= 2;
+
+            std::vector<value_type> old( capacity, empty_slot() );
+            old.swap( _slots );
+            _mask = capacity - 1;
+            _size = 0;
+            for( auto& slot : old )
+               if( slot.first.number != empty_key )
+                  emplace( slot.first, std::move( slot.second ) );
+         }
+
+      private:
+         static const uint64_t empty_key    = uint64_t(-1);
+         static const size_t   min_capacity = 16;
+         static const size_t   npos         = size_t(-1);
+
+         static value_type empty_slot()
+         {
+            value_type slot;
+            slot.first.number = empty_key;
+            return slot;
+         }
+
+         size_t bucket( object_id_type id )const
+         {
+            // ids are mostly sequential, spread them with a fibonacci multiplier
+            return size_t( ( id.number * 0x9E3779B97F4A7C15ULL ) >> 32 ) & _mask;
+         }
+
+         size_t locate( object_id_type id )const
+         {
+            if( _slots.empty() ) return npos;
+            for( size_t i = bucket( id ); ; i = ( i + 1 ) & _mask )
+            {
+               if( _slots[i].first == id ) return i;
+               if( _slots[i].first.number == empty_key ) return npos;
+            }
+         }
+
+         std::vector<value_type> _slots;
+         size_t                  _mask = 0;
+         size_t                  _size = 0;
+   };
+
+   /**
+    * @class flat_id_set
+    * @brief A set of object ids on top of flat_id_map
+    */
+   class flat_id_set
+   {
+         typedef flat_id_map<bool> map_type;
+
+      public:
+         class const_iterator
+         {
+            public:
+               const_iterator( map_type::const_iterator itr ):_itr(itr) {}
+
+               const object_id_type& operator*()const  { return _itr->first; }
+               const object_id_type* operator->()const { return &_itr->first; }
+               const_iterator& operator++() { ++_itr; return *this; }
+
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._itr == b._itr; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._itr != b._itr; }
+
+            private:
+               map_type::const_iterator _itr;
+         };
+         typedef const_iterator iterator;
+
+         size_t size()const  { return _map.size(); }
+         bool   empty()const { return _map.empty(); }
+
+         const_iterator begin()const { return const_iterator( _map.begin() ); }
+         const_iterator end()const   { return const_iterator( _map.end() ); }
+
+         const_iterator find( object_id_type id )const { return const_iterator( _map.find( id ) ); }
+         size_t         count( object_id_type id )const { return _map.count( id ); }
+         bool           insert( object_id_type id ) { return _map.emplace( id, true ).second; }
+         size_t         erase( object_id_type id ) { return _map.erase( id ); }
+         void           clear() { _map.clear(); }
+
+      private:
+         map_type _map;
+   };
+
+} } // graphene::db
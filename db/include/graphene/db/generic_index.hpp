@@ -27,6 +27,7 @@
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
+#include <boost/mpl/size.hpp>
 
 namespace graphene { namespace db {
 
@@ -66,6 +67,13 @@ namespace graphene { namespace db {
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
+         {
+            modify_inline( obj, m );
+         }
+
+         /** modify() without type erasure, m is called inline with an ObjectType& */
+         template<typename Lambda>
+         void modify_inline( const object& obj, Lambda&& m )
          {
             assert(nullptr != dynamic_cast<const ObjectType*>(&obj));
             std::exception_ptr exc;
@@ -110,6 +118,18 @@ namespace graphene { namespace db {
             } FC_CAPTURE_AND_RETHROW()
          }
 
+         virtual uint64_t get_object_count()const override
+         {
+            return _indices.size();
+         }
+
+         /** estimated as one node per object, holding the object and the links of every index */
+         virtual uint64_t get_object_memory_usage()const override
+         {
+            const size_t links = boost::mpl::size< typename MultiIndexType::index_type_list >::value * 3 * sizeof(void*);
+            return _indices.size() * ( sizeof(ObjectType) + links );
+         }
+
          const index_type& indices()const { return _indices; }
 
       private:
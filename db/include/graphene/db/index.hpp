@@ -23,15 +23,27 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/flat_id_map.hpp>
 
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
+#include <fc/thread/parallel.hpp>
+
+#include <boost/container/flat_map.hpp>
 
 #include <fstream>
+#include <map>
+#include <mutex>
 #include <stack>
 
+/** Must be used in the global namespace, next to the declaration of the index type */
+#define GRAPHENE_DB_DECLARE_PRIMARY_INDEX( OBJECT, ... ) \
+   namespace graphene { namespace db { \
+   template<> struct primary_index_of< OBJECT > { typedef __VA_ARGS__ type; }; \
+   } }
+
 namespace graphene { namespace db {
    class object_database;
    using fc::path;
@@ -81,6 +93,13 @@ namespace graphene { namespace db {
          virtual void           set_next_id( object_id_type id ) = 0;
 
          virtual const object&  load( const std::vector<char>& data ) = 0;
+
+         /**
+          *  Hint that about count objects are going to be loaded, indexes that can preallocate
+          *  storage should do so.  The default implementation does nothing.
+          */
+         virtual void reserve( size_t count ) {}
+
          /**
           *  Polymorphically insert by moving an object into the index.
           *  this should throw if the object is already in the database.
@@ -99,11 +118,46 @@ namespace graphene { namespace db {
          virtual void open( const fc::path& db ) = 0;
          virtual void save( const fc::path& db ) = 0;
 
+         /**
+          *  Incremental checkpoints, see object_database::flush()
+          *  @{
+          */
+         /** Starts or stops recording which objects change, anything recorded so far is discarded */
+         virtual void set_change_tracking( bool enable ) = 0;
+         /** Appends the recorded changes as one batch tagged with sequence to the delta log and clears them */
+         virtual void save_changes( const fc::path& log, uint64_t sequence ) = 0;
+         /** Applies all batches up to and including last_sequence from the delta log, later ones are dropped */
+         virtual void open_changes( const fc::path& log, uint64_t last_sequence ) = 0;
+         /// @}
+
+         /** @return the root of the state_hash_index tree over all objects of this index */
+         virtual fc::sha256 get_state_hash()const = 0;
+         /**
+          * Maintains the hash tree from now on instead of building it on every get_state_hash() call. This
+          * costs one object hash per change.
+          */
+         virtual void       enable_state_hash() = 0;
+
 
 
          /** @return the object with id or nullptr if not found */
          virtual const object*      find( object_id_type id )const = 0;
 
+         /** @return the number of objects in this index */
+         virtual uint64_t           get_object_count()const = 0;
+         /**
+          * @return estimated heap bytes used by the fixed-size part of the objects and the container nodes
+          * holding them, memory owned by members of the objects is not included
+          */
+         virtual uint64_t           get_object_memory_usage()const = 0;
+         /**
+          * @return estimated heap bytes owned by members of the objects, e.g. strings, containers and operations,
+          * extrapolated from a sample of the objects
+          */
+         virtual uint64_t           get_member_memory_usage()const = 0;
+         /** @return estimated heap bytes used by the secondary indexes */
+         virtual uint64_t           get_secondary_memory_usage()const = 0;
+
          /**
           * This version will automatically check for nullptr and throw an exception if the
           * object ID could not be found.
@@ -132,6 +186,12 @@ namespace graphene { namespace db {
          virtual void               inspect_all_objects(std::function<void(const object&)> inspector)const = 0;
          virtual void               add_observer( const shared_ptr<index_observer>& ) = 0;
 
+         /**
+          *  While deferred, deferrable secondary indexes are not maintained, they are rebuilt in one pass
+          *  when the deferral is lifted.
+          */
+         virtual void               defer_secondary_indexes( bool defer ) = 0;
+
          virtual void               object_from_variant( const fc::variant& var, object& obj, uint32_t max_depth )const = 0;
          virtual void               object_default( object& obj )const = 0;
    };
@@ -144,6 +204,25 @@ namespace graphene { namespace db {
          virtual void object_removed( const object& obj ){};
          virtual void about_to_modify( const object& before ){};
          virtual void object_modified( const object& after  ){};
+
+         /** called with a batch of inserted objects in id order, indexes may override it to build in one pass */
+         virtual void objects_inserted( const vector<const object*>& objs )
+         {
+            for( const object* obj : objs )
+               object_inserted( *obj );
+         }
+
+         /**
+          *  An index which is not consulted while the chain is replayed may return true here. While the
+          *  primary index defers secondary indexes it is then not notified at all, instead it is cleared and
+          *  rebuilt with objects_inserted() from all objects when the deferral ends.
+          */
+         virtual bool is_deferrable()const { return false; }
+         /** removes all entries, only called on deferrable indexes */
+         virtual void clear(){};
+
+         /** @return estimated heap bytes used by this index */
+         virtual uint64_t get_memory_usage()const { return 0; }
    };
 
    /**
@@ -185,8 +264,39 @@ namespace graphene { namespace db {
          }
 
       protected:
+         bool is_notified( const secondary_index& item )const
+         {
+            return !_defer_secondary || !item.is_deferrable();
+         }
+         void notify_inserted( const object& obj )const
+         {
+            for( const auto& item : _sindex )
+               if( is_notified( *item ) ) item->object_inserted( obj );
+         }
+         void notify_removed( const object& obj )const
+         {
+            for( const auto& item : _sindex )
+               if( is_notified( *item ) ) item->object_removed( obj );
+         }
+         void notify_about_to_modify( const object& obj )const
+         {
+            for( const auto& item : _sindex )
+               if( is_notified( *item ) ) item->about_to_modify( obj );
+         }
+         void notify_modified( const object& obj )const
+         {
+            for( const auto& item : _sindex )
+               if( is_notified( *item ) ) item->object_modified( obj );
+         }
+
          vector< shared_ptr<index_observer> >   _observers;
          vector< unique_ptr<secondary_index> >  _sindex;
+         bool                                   _defer_secondary = false;
+
+         /** objects created, modified or removed since the last checkpoint, only maintained if _track_changes */
+         bool                                   _track_changes = false;
+         std::unordered_set<object_id_type>     _changed_ids;
+         std::unordered_set<object_id_type>     _removed_ids;
 
       private:
          object_database& _db;
@@ -272,6 +382,11 @@ namespace graphene { namespace db {
             ids_being_modified.pop();
          }
 
+         virtual uint64_t get_memory_usage()const override
+         {
+            return content.size() * ( sizeof( content.front() ) + ( 1ULL << chunkbits ) * sizeof( const Object* ) );
+         }
+
          template< typename object_id >
          const Object* find( const object_id& id )const
          {
@@ -298,11 +413,287 @@ namespace graphene { namespace db {
          };
    };
 
+   /** Passing this as DirectBits to primary_index selects a hashed_id_index instead of a direct_index */
+   const uint8_t hashed_ids = 0xff;
+
+   /** @class hashed_id_index
+    *  @brief A secondary index that tracks objects in an open addressing hash table keyed by object id.
+    *  It gives constant time id lookups for sparsely populated indexes, i.e. objects which are created
+    *  and removed constantly, where a direct_index would be mostly holes. Ordered iteration is still
+    *  provided by the ordered by_id index of the primary index.
+    */
+   template<typename Object>
+   class hashed_id_index : public secondary_index
+   {
+         flat_id_map< const Object* > content;
+         std::stack< object_id_type > ids_being_modified;
+
+      public:
+         virtual ~hashed_id_index(){}
+
+         virtual void object_inserted( const object& obj )
+         {
+            FC_ASSERT( nullptr != dynamic_cast<const Object*>(&obj), "Wrong object type!" );
+            auto result = content.emplace( obj.id, static_cast<const Object*>( &obj ) );
+            FC_ASSERT( result.second, "Overwriting insert at {id}!", ("id",obj.id) );
+         }
+
+         virtual void object_removed( const object& obj )
+         {
+            size_t removed = content.erase( obj.id );
+            FC_ASSERT( removed > 0, "Removing non-existent object {id}!", ("id",obj.id) );
+         }
+
+         virtual void about_to_modify( const object& before )
+         {
+            ids_being_modified.emplace( before.id );
+         }
+
+         virtual void object_modified( const object& after  )
+         {
+            FC_ASSERT( ids_being_modified.top() == after.id, "Modification of ID is not supported!");
+            ids_being_modified.pop();
+         }
+
+         virtual uint64_t get_memory_usage()const override
+         {
+            return content.capacity() * sizeof( typename flat_id_map< const Object* >::value_type );
+         }
+
+         const Object* find( const object_id_type& id )const
+         {
+            auto itr = content.find( id );
+            if( itr == content.end() ) return nullptr;
+            return itr->second;
+         }
+
+         template< typename object_id >
+         const Object& get( const object_id& id )const
+         {
+            const Object* ptr = find( id );
+            FC_ASSERT( ptr != nullptr, "Object not found!" );
+            return *ptr;
+         };
+   };
+
+   /**
+    *  The leaf an object contributes to the state hash. Specialize it for objects with fields that plugins or
+    *  other node-local settings maintain, so that all nodes that applied the same blocks get the same hash.
+    */
+   template<typename Object>
+   struct state_hash_of
+   {
+      static fc::sha256 hash( const Object& o ) { return fc::sha256::hash( o ); }
+   };
+
+   /**
+    *  Heap bytes owned by the members of an object. Fixed-size members never pack larger than they are in memory,
+    *  so the excess of the packed size over sizeof(Object) is a lower bound. Specialize it for objects whose
+    *  members own memory that is not serialized.
+    */
+   template<typename Object>
+   struct member_memory_of
+   {
+      static uint64_t bytes( const Object& o )
+      {
+         const size_t packed = fc::raw::pack_size( o );
+         return packed > sizeof(Object) ? packed - sizeof(Object) : 0;
+      }
+   };
+
+   /** @class state_hash_index
+    *  @brief A secondary index that maintains a two level hash tree over the packed objects of an index.
+    *
+    *  Every object is hashed into a leaf when it is inserted or modified. Leaves are grouped into buckets of
+    *  2^bucket_bits consecutive instances, a bucket hashes its leaves in instance order and the root hashes the
+    *  non-empty buckets in order. Bucket hashes and the root are recomputed lazily, so a change costs one
+    *  object hash and reading the root after a block only rehashes the buckets touched by that block.
+    */
+   template<typename Object>
+   class state_hash_index : public secondary_index
+   {
+      public:
+         static const uint8_t bucket_bits = 10;
+
+         virtual ~state_hash_index(){}
+
+         virtual void object_inserted( const object& obj )
+         {
+            set_leaf( obj );
+         }
+
+         virtual void object_removed( const object& obj )
+         {
+            std::lock_guard<std::mutex> lock( _mutex );
+            const uint64_t instance = obj.id.instance();
+            auto itr = _buckets.find( instance >> bucket_bits );
+            FC_ASSERT( itr != _buckets.end() && itr->second.leaves.erase( instance ) > 0,
+                       "Removing non-existent object ${id}!", ("id",obj.id) );
+            if( itr->second.leaves.empty() )
+               _buckets.erase( itr );
+            else
+               itr->second.dirty = true;
+            _root_dirty = true;
+         }
+
+         virtual void object_modified( const object& after )
+         {
+            set_leaf( after );
+         }
+
+         virtual void clear()
+         {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _buckets.clear();
+            _root_dirty = true;
+         }
+
+         virtual uint64_t get_memory_usage()const override
+         {
+            std::lock_guard<std::mutex> lock( _mutex );
+            uint64_t result = _buckets.size() * ( sizeof( typename bucket_map::value_type ) + 4 * sizeof(void*) );
+            for( const auto& item : _buckets )
+               result += item.second.leaves.capacity() * sizeof( typename leaf_map::value_type );
+            return result;
+         }
+
+         /** @return the root of the tree, the hash of an empty index is the hash of no data */
+         fc::sha256 root()const
+         {
+            std::lock_guard<std::mutex> lock( _mutex );
+            if( !_root_dirty ) return _root;
+            fc::sha256::encoder root_enc;
+            for( auto& item : _buckets )
+            {
+               if( item.second.dirty )
+               {
+                  fc::sha256::encoder enc;
+                  for( const auto& leaf : item.second.leaves )
+                     enc.write( leaf.second.data(), leaf.second.data_size() );
+                  item.second.hash  = enc.result();
+                  item.second.dirty = false;
+               }
+               root_enc.write( item.second.hash.data(), item.second.hash.data_size() );
+            }
+            _root = root_enc.result();
+            _root_dirty = false;
+            return _root;
+         }
+
+      private:
+         typedef boost::container::flat_map< uint64_t, fc::sha256 > leaf_map;
+         struct bucket
+         {
+            leaf_map   leaves;
+            fc::sha256 hash;
+            bool       dirty = true;
+         };
+         typedef std::map< uint64_t, bucket > bucket_map;
+
+         void set_leaf( const object& obj )
+         {
+            const Object* o = dynamic_cast<const Object*>( &obj );
+            FC_ASSERT( o != nullptr, "Wrong object type!" );
+            // the packed object includes its id, equal leaves at different instances can not cancel out
+            const fc::sha256 leaf = state_hash_of< Object >::hash( *o );
+            const uint64_t instance = obj.id.instance();
+            std::lock_guard<std::mutex> lock( _mutex );
+            auto& b = _buckets[ instance >> bucket_bits ];
+            b.leaves[ instance ] = leaf;
+            b.dirty = true;
+            _root_dirty = true;
+         }
+
+         mutable bucket_map  _buckets;
+         mutable fc::sha256  _root;
+         mutable bool        _root_dirty = true;
+         mutable std::mutex  _mutex;
+   };
+
+   /** Selects the secondary index primary_index uses for id lookups */
+   template<typename Object, uint8_t DirectBits>
+   struct id_lookup_index { typedef direct_index< Object, DirectBits > type; };
+   template<typename Object>
+   struct id_lookup_index< Object, hashed_ids > { typedef hashed_id_index< Object > type; };
+
+   /**
+    *  Maps an object type to the type of the primary_index it is stored in. Declaring it with
+    *  GRAPHENE_DB_DECLARE_PRIMARY_INDEX lets object_database::modify() use primary_index::modify_inline()
+    *  for that type, the declaration is checked against the index passed to object_database::add_index().
+    */
+   template<typename Object>
+   struct primary_index_of { typedef void type; };
+
+   /**
+    * @class snapshot_header
+    * @brief Fixed-size header at the beginning of every index file written by primary_index::save
+    *
+    * The header is followed by the objects, packed back to back with fc::raw without a per-object length
+    * prefix so that they can be unpacked directly from the mapped file. The objects are split into shards
+    * of at most objects_per_shard objects which are decoded in parallel on load. The shard table, a packed
+    * vector of snapshot_shard, is written after the last shard at shard_table_pos. content_hash is the
+    * sha256 of the packed shard table, each shard carries the sha256 of its own bytes.
+    */
+   struct snapshot_header
+   {
+      static const uint64_t magic_value       = 0x504e534244485047ULL; // "GPHDBSNP"
+      static const uint32_t current_format    = 2;
+      static const uint64_t objects_per_shard = 1 << 16;
+
+      uint64_t       magic           = magic_value;
+      uint32_t       format_version  = current_format;
+      fc::sha256     object_version;
+      object_id_type next_id;
+      uint64_t       object_count    = 0;
+      uint32_t       shard_count     = 0;
+      uint64_t       shard_table_pos = 0;
+      fc::sha256     content_hash;
+   };
+
+   struct snapshot_shard
+   {
+      uint64_t       object_count = 0;
+      uint64_t       size         = 0;
+      fc::sha256     content_hash;
+   };
+
+   /**
+    * @class delta_batch_header
+    * @brief Header of one batch of changes appended to an index delta log by primary_index::save_changes
+    *
+    * It is followed by content_size bytes holding changed_count packed objects and then removed_count
+    * packed object ids. content_hash is the sha256 of these bytes, a batch that fails the check is
+    * treated as the torn end of the log.
+    */
+   struct delta_batch_header
+   {
+      uint64_t       magic         = snapshot_header::magic_value;
+      uint64_t       sequence      = 0;
+      object_id_type next_id;
+      uint64_t       changed_count = 0;
+      uint64_t       removed_count = 0;
+      uint64_t       content_size  = 0;
+      fc::sha256     content_hash;
+   };
+
+} } // graphene::db
+
+FC_REFLECT( graphene::db::snapshot_header,
+            (magic)(format_version)(object_version)(next_id)(object_count)(shard_count)(shard_table_pos)(content_hash) )
+FC_REFLECT( graphene::db::snapshot_shard, (object_count)(size)(content_hash) )
+FC_REFLECT( graphene::db::delta_batch_header,
+            (magic)(sequence)(next_id)(changed_count)(removed_count)(content_size)(content_hash) )
+
+namespace graphene { namespace db {
+
    /**
     * @class primary_index
     * @brief  Wraps a derived index to intercept calls to create, modify, and remove so that
     *  callbacks may be fired and undo state saved.
     *
+    *  If DirectBits is non-zero, find() is served by a direct_index with chunks of 2^DirectBits objects,
+    *  or by a hashed_id_index if DirectBits is hashed_ids.
+    *
     *  @see http://en.wikipedia.org/wiki/Curiously_recurring_template_pattern
     */
    template<typename DerivedIndex, uint8_t DirectBits = 0>
@@ -310,12 +701,13 @@ namespace graphene { namespace db {
    {
       public:
          typedef typename DerivedIndex::object_type object_type;
+         typedef typename id_lookup_index< object_type, DirectBits >::type id_index_type;
 
          primary_index( object_database& db )
          :base_primary_index(db),_next_id(object_type::space_id,object_type::type_id,0)
          {
             if( DirectBits > 0 )
-               _direct_by_id = add_secondary_index< direct_index< object_type, DirectBits > >();
+               _direct_by_id = add_secondary_index< id_index_type >();
          }
 
          virtual uint8_t object_space_id()const override
@@ -347,18 +739,84 @@ namespace graphene { namespace db {
             if( !fc::exists( db ) ) return;
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
             fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
-            fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
-            fc::sha256 open_ver;
-
-            fc::raw::unpack(ds, _next_id);
-            fc::raw::unpack(ds, open_ver);
-            FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
-            vector<char> tmp;
-            while( ds.remaining() > 0 )
+            const char* const begin = (const char*)mr.get_address();
+            const size_t file_size = mr.get_size();
+            fc::datastream<const char*> ds( begin, file_size );
+
+            snapshot_header header;
+            fc::raw::unpack( ds, header );
+            FC_ASSERT( header.magic == snapshot_header::magic_value, "Not an object_database snapshot file: ${f}", ("f",db) );
+            FC_ASSERT( header.format_version == snapshot_header::current_format,
+                       "Unsupported snapshot format ${v}", ("v",header.format_version) );
+            FC_ASSERT( header.object_version == get_object_version(),
+                       "Incompatible Version, the serialization of objects in this index has changed" );
+
+            const size_t data_begin = file_size - ds.remaining();
+            FC_ASSERT( header.shard_table_pos >= data_begin && header.shard_table_pos <= file_size,
+                       "Invalid shard table position in index file ${f}", ("f",db) );
+            const char* const table = begin + header.shard_table_pos;
+            const size_t table_size = file_size - header.shard_table_pos;
+            FC_ASSERT( hash_content( table, table_size ) == header.content_hash,
+                       "Checksum mismatch, index file ${f} is corrupted", ("f",db) );
+            vector<snapshot_shard> shards;
+            fc::datastream<const char*> tds( table, table_size );
+            fc::raw::unpack( tds, shards );
+            FC_ASSERT( shards.size() == header.shard_count && tds.remaining() == 0,
+                       "Invalid shard table in index file ${f}", ("f",db) );
+
+            vector<size_t> offsets;
+            offsets.reserve( shards.size() );
+            size_t   pos   = data_begin;
+            uint64_t total = 0;
+            for( const auto& shard : shards )
             {
-               fc::raw::unpack( ds, tmp );
-               load( tmp );
+               offsets.push_back( pos );
+               pos   += shard.size;
+               total += shard.object_count;
+            }
+            FC_ASSERT( pos == header.shard_table_pos && total == header.object_count,
+                       "Shard table does not match the contents of index file ${f}", ("f",db) );
+
+            // decode all shards in parallel, insert them in order as they become ready
+            vector< vector<object_type> > decoded( shards.size() );
+            vector< fc::future<void> > tasks;
+            tasks.reserve( shards.size() );
+            for( size_t i = 0; i < shards.size(); ++i )
+               tasks.push_back( fc::do_parallel( [&db,&shards,&decoded,begin,&offsets,i] () {
+                  const char* const shard_begin = begin + offsets[i];
+                  FC_ASSERT( hash_content( shard_begin, shards[i].size ) == shards[i].content_hash,
+                             "Checksum mismatch in shard ${i}, index file ${f} is corrupted", ("i",i)("f",db) );
+                  fc::datastream<const char*> sds( shard_begin, shards[i].size );
+                  decoded[i].resize( shards[i].object_count );
+                  for( auto& obj : decoded[i] )
+                     fc::raw::unpack( sds, obj );
+                  FC_ASSERT( sds.remaining() == 0, "Trailing data in shard ${i} of index file ${f}", ("i",i)("f",db) );
+               }) );
+
+            _next_id = header.next_id;
+            this->reserve( header.object_count );
+            vector<const object*> loaded;
+            loaded.reserve( header.object_count );
+            try {
+               for( size_t i = 0; i < shards.size(); ++i )
+               {
+                  tasks[i].wait();
+                  for( auto& obj : decoded[i] )
+                     loaded.push_back( &DerivedIndex::insert( std::move(obj) ) );
+                  vector<object_type>().swap( decoded[i] );
+               }
+            } catch( ... ) {
+               // the remaining tasks reference the mapped file and the local buffers
+               for( auto& task : tasks )
+                  try { task.wait(); } catch( ... ) {}
+               throw;
             }
+
+            // objects read from disk are not recorded in the undo history, secondary indexes are built in one
+            // pass per index after everything has been inserted
+            for( const auto& item : _sindex )
+               if( is_notified( *item ) )
+                  item->objects_inserted( loaded );
          }
 
          virtual void save( const path& db ) override 
@@ -366,30 +824,181 @@ namespace graphene { namespace db {
             std::ofstream out( db.generic_string(), 
                                std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
             FC_ASSERT( out );
-            auto ver  = get_object_version();
-            fc::raw::pack( out, _next_id );
-            fc::raw::pack( out, ver );
+            snapshot_header header;
+            header.object_version = get_object_version();
+            header.next_id = _next_id;
+            // reserve room for the header, it is rewritten once the shard table is known
+            fc::raw::pack( out, header );
+
+            vector<snapshot_shard> shards;
+            snapshot_shard shard;
+            fc::sha256::encoder enc;
+            vector<char> buffer;
             this->inspect_all_objects( [&]( const object& o ) {
-                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
+                const auto& obj = static_cast<const object_type&>(o);
+                buffer.resize( fc::raw::pack_size( obj ) );
+                fc::datastream<char*> ds( buffer.data(), buffer.size() );
+                fc::raw::pack( ds, obj );
+                enc.write( buffer.data(), buffer.size() );
+                out.write( buffer.data(), buffer.size() );
+                shard.size += buffer.size();
+                ++header.object_count;
+                if( ++shard.object_count == snapshot_header::objects_per_shard )
+                {
+                   shard.content_hash = enc.result();
+                   shards.push_back( shard );
+                   shard = snapshot_shard();
+                   enc.reset();
+                }
             });
+            if( shard.object_count > 0 )
+            {
+               shard.content_hash = enc.result();
+               shards.push_back( shard );
+            }
+
+            const auto table = fc::raw::pack( shards );
+            header.shard_count = shards.size();
+            header.shard_table_pos = out.tellp();
+            header.content_hash = fc::sha256::hash( table.data(), table.size() );
+            out.write( table.data(), table.size() );
+
+            out.seekp( 0 );
+            fc::raw::pack( out, header );
+            FC_ASSERT( out, "Failed to write index file ${f}", ("f",db) );
          }
 
-         virtual const object&  load( const std::vector<char>& data )override
+         virtual fc::sha256 get_state_hash()const override
          {
-            const auto& result = DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
-            for( const auto& item : _sindex )
-               item->object_inserted( result );
-            return result;
+            if( _state_hash != nullptr )
+               return _state_hash->root();
+            state_hash_index< object_type > tree;
+            this->inspect_all_objects( [&tree]( const object& o ) { tree.object_inserted( o ); } );
+            return tree.root();
          }
 
+         virtual void enable_state_hash()override
+         {
+            if( _state_hash != nullptr ) return;
+            _state_hash = add_secondary_index< state_hash_index< object_type > >();
+            vector<const object*> all;
+            this->inspect_all_objects( [&all]( const object& o ) { all.push_back( &o ); } );
+            _state_hash->objects_inserted( all );
+         }
+
+         virtual void set_change_tracking( bool enable )override
+         {
+            _track_changes = enable;
+            _changed_ids.clear();
+            _removed_ids.clear();
+         }
+
+         virtual void save_changes( const path& log, uint64_t sequence )override
+         {
+            if( _changed_ids.empty() && _removed_ids.empty() ) return;
+
+            delta_batch_header header;
+            header.sequence      = sequence;
+            header.next_id       = _next_id;
+            header.changed_count = _changed_ids.size();
+            header.removed_count = _removed_ids.size();
+
+            vector<char> content;
+            for( const auto& id : _changed_ids )
+            {
+               const object* o = DerivedIndex::find( id );
+               FC_ASSERT( o != nullptr, "Changed object ${id} is missing", ("id",id) );
+               const auto& obj = static_cast<const object_type&>(*o);
+               const size_t pos = content.size();
+               content.resize( pos + fc::raw::pack_size( obj ) );
+               fc::datastream<char*> ds( content.data() + pos, content.size() - pos );
+               fc::raw::pack( ds, obj );
+            }
+            for( const auto& id : _removed_ids )
+            {
+               const size_t pos = content.size();
+               content.resize( pos + fc::raw::pack_size( id ) );
+               fc::datastream<char*> ds( content.data() + pos, content.size() - pos );
+               fc::raw::pack( ds, id );
+            }
+            header.content_size = content.size();
+            header.content_hash = fc::sha256::hash( content.data(), content.size() );
+
+            std::ofstream out( log.generic_string(),
+                               std::ofstream::binary | std::ofstream::out | std::ofstream::app );
+            FC_ASSERT( out );
+            fc::raw::pack( out, header );
+            out.write( content.data(), content.size() );
+            out.flush();
+            FC_ASSERT( out, "Failed to append to delta log ${f}", ("f",log) );
+
+            _changed_ids.clear();
+            _removed_ids.clear();
+         }
+
+         virtual void open_changes( const path& log, uint64_t last_sequence )override
+         {
+            if( !fc::exists( log ) ) return;
+            size_t valid_size = 0;
+            {
+               const size_t file_size = fc::file_size( log );
+               fc::file_mapping fm( log.generic_string().c_str(), fc::read_only );
+               fc::mapped_region mr( fm, fc::read_only, 0, file_size );
+               const char* const begin = (const char*)mr.get_address();
+               fc::datastream<const char*> ds( begin, file_size );
+               const size_t header_size = fc::raw::pack_size( delta_batch_header() );
+               while( ds.remaining() >= header_size )
+               {
+                  delta_batch_header header;
+                  fc::raw::unpack( ds, header );
+                  if( header.magic != snapshot_header::magic_value || header.sequence > last_sequence
+                        || header.content_size > ds.remaining() )
+                     break;
+                  const char* content = begin + ( file_size - ds.remaining() );
+                  if( fc::sha256::hash( content, header.content_size ) != header.content_hash )
+                     break;
+
+                  for( uint64_t i = 0; i < header.changed_count; ++i )
+                  {
+                     object_type obj;
+                     fc::raw::unpack( ds, obj );
+                     const object* existing = DerivedIndex::find( obj.id );
+                     if( existing == nullptr )
+                     {
+                        load_object( std::move(obj) );
+                        continue;
+                     }
+                     notify_about_to_modify( *existing );
+                     DerivedIndex::modify( *existing, [&obj]( object& o ) { o.move_from( obj ); } );
+                     notify_modified( *existing );
+                  }
+                  for( uint64_t i = 0; i < header.removed_count; ++i )
+                  {
+                     object_id_type id;
+                     fc::raw::unpack( ds, id );
+                     const object* existing = DerivedIndex::find( id );
+                     if( existing == nullptr ) continue;
+                     notify_removed( *existing );
+                     DerivedIndex::remove( *existing );
+                  }
+                  _next_id = header.next_id;
+                  valid_size = file_size - ds.remaining();
+               }
+               if( valid_size == file_size ) return;
+            }
+            wlog( "Dropping uncommitted tail of delta log ${f}", ("f",log) );
+            fc::resize_file( log, valid_size );
+         }
+
+         virtual const object&  load( const std::vector<char>& data )override
+         {
+            return load_object( fc::raw::unpack<object_type>( data ) );
+         }
 
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
             const auto& result = DerivedIndex::create( constructor );
-            for( const auto& item : _sindex )
-               item->object_inserted( result );
+            notify_inserted( result );
             on_add( result );
             return result;
          }
@@ -397,16 +1006,14 @@ namespace graphene { namespace db {
          virtual const object& insert( object&& obj ) override
          {
             const auto& result = DerivedIndex::insert( std::move( obj ) );
-            for( const auto& item : _sindex )
-               item->object_inserted( result );
+            notify_inserted( result );
             on_add( result );
             return result;
          }
 
          virtual void  remove( const object& obj ) override
          {
-            for( const auto& item : _sindex )
-               item->object_removed( obj );
+            notify_removed( obj );
             on_remove(obj);
             DerivedIndex::remove(obj);
          }
@@ -414,11 +1021,23 @@ namespace graphene { namespace db {
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
             save_undo( obj );
-            for( const auto& item : _sindex )
-               item->about_to_modify( obj );
+            notify_about_to_modify( obj );
             DerivedIndex::modify( obj, m );
-            for( const auto& item : _sindex )
-               item->object_modified( obj );
+            notify_modified( obj );
+            on_modify( obj );
+         }
+
+         /**
+          *  Non-virtual version of modify() that calls m inline instead of through a std::function.
+          *  It saves undo state and notifies secondary indexes and observers exactly like modify().
+          */
+         template<typename Lambda>
+         void modify_inline( const object_type& obj, Lambda&& m )
+         {
+            save_undo( obj );
+            notify_about_to_modify( obj );
+            DerivedIndex::modify_inline( obj, std::forward<Lambda>(m) );
+            notify_modified( obj );
             on_modify( obj );
          }
 
@@ -427,6 +1046,47 @@ namespace graphene { namespace db {
             _observers.emplace_back( o );
          }
 
+         /** samples up to 256 instances spread evenly over the id range, which costs a lookup each */
+         virtual uint64_t get_member_memory_usage()const override
+         {
+            const uint64_t end = _next_id.instance();
+            const uint64_t step = std::max<uint64_t>( 1, end / 256 );
+            uint64_t sampled = 0;
+            uint64_t bytes = 0;
+            for( uint64_t instance = 0; instance < end; instance += step )
+               if( const object* o = DerivedIndex::find( object_id_type( object_type::space_id, object_type::type_id,
+                                                                         instance ) ) )
+               {
+                  bytes += member_memory_of< object_type >::bytes( static_cast<const object_type&>( *o ) );
+                  ++sampled;
+               }
+            return sampled > 0 ? bytes * DerivedIndex::get_object_count() / sampled : 0;
+         }
+
+         virtual uint64_t get_secondary_memory_usage()const override
+         {
+            uint64_t result = 0;
+            for( const auto& item : _sindex )
+               result += item->get_memory_usage();
+            return result;
+         }
+
+         virtual void defer_secondary_indexes( bool defer ) override
+         {
+            if( defer == _defer_secondary ) return;
+            _defer_secondary = defer;
+            if( defer ) return;
+
+            vector<const object*> all;
+            this->inspect_all_objects( [&all]( const object& o ) { all.push_back( &o ); } );
+            for( const auto& item : _sindex )
+               if( item->is_deferrable() )
+               {
+                  item->clear();
+                  item->objects_inserted( all );
+               }
+         }
+
          virtual void object_from_variant( const fc::variant& var, object& obj, uint32_t max_depth )const override
          {
             object_id_type id = obj.id;
@@ -446,8 +1106,31 @@ namespace graphene { namespace db {
          }
 
       private:
+         /** the sha256 encoder takes 32 bit lengths, feed it in chunks to support large buffers */
+         static fc::sha256 hash_content( const char* data, size_t size )
+         {
+            fc::sha256::encoder enc;
+            while( size > 0 )
+            {
+               const uint32_t chunk = uint32_t( std::min<size_t>( size, 1u << 30 ) );
+               enc.write( data, chunk );
+               data += chunk;
+               size -= chunk;
+            }
+            return enc.result();
+         }
+
+         /** inserts an object read from disk, it is not recorded in the undo history */
+         const object& load_object( object_type&& obj )
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            notify_inserted( result );
+            return result;
+         }
+
          object_id_type                                 _next_id;
-         const direct_index< object_type, DirectBits >* _direct_by_id = nullptr;
+         const id_index_type*                           _direct_by_id = nullptr;
+         state_hash_index< object_type >*               _state_hash = nullptr;
    };
 
 } } // graphene::db
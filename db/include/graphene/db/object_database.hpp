@@ -28,10 +28,26 @@
 
 #include <fc/log/logger.hpp>
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 
 namespace graphene { namespace db {
 
+   /** Estimated memory footprint of one index, see object_database::get_memory_usage() */
+   struct index_memory_usage
+   {
+      uint8_t  space_id        = 0;
+      uint8_t  type_id         = 0;
+      uint64_t object_count    = 0;
+      uint64_t fixed_bytes     = 0; ///< fixed-size part of the objects and their container nodes
+      uint64_t member_bytes    = 0; ///< owned by members of the objects, estimated from a sample
+      uint64_t secondary_bytes = 0;
+   };
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -42,14 +58,58 @@ namespace graphene { namespace db {
          object_database();
          ~object_database();
 
-         void reset_indexes() { _index.clear(); _index.resize(255); }
+         void reset_indexes() { _index.clear(); _index.resize(255); _state_indexes.clear(); }
+
+         /**
+          * Declares the indexes added so far, except the excluded ones, as the ones that make up the state
+          * covered by get_state_hash(), and enables their hash trees if state hash tracking is on. Indexes added
+          * later, e.g. by plugins, are not covered.
+          */
+         void mark_state_indexes( const std::set< std::pair<uint8_t,uint8_t> >& excluded = {} );
+
+         /**
+          * Maintains incremental hash trees on the state indexes from now on, so that get_state_hash() only
+          * rehashes what changed since the previous call. Off by default: every object change then costs a
+          * pack and a sha256, and without it get_state_hash() hashes all objects instead.
+          */
+         void enable_state_hash_tracking();
+         bool is_state_hash_tracked()const { return _track_state_hash; }
+
+         /**
+          * @return the sha256 over the hashes of all state indexes in (space, type) order, two nodes that
+          * applied the same blocks return the same hash
+          */
+         fc::sha256 get_state_hash()const;
+         /** @return the root of the hash tree of one index, see index::get_state_hash() */
+         fc::sha256 get_index_state_hash( uint8_t space_id, uint8_t type_id )const;
 
          void open(const fc::path& data_dir );
 
          /**
-          * Saves the complete state of the object_database to disk, this could take a while
+          * Saves the state of the object_database to disk. By default the complete state is rewritten, which
+          * could take a while. With incremental flushing enabled, only the objects changed since the previous
+          * flush are appended to per-index delta logs, and every compaction_interval flushes (or once the logs
+          * outgrow the snapshot) the complete state is rewritten again.
           */
          void flush();
+
+         /**
+          * Enables or disables incremental flushing, must be called before open()
+          */
+         void set_incremental_flush( bool enable, uint32_t compaction_interval = 100 );
+
+         /** @return the estimated memory footprint of every index, this walks all objects */
+         vector<index_memory_usage> get_memory_usage()const;
+         /** Computes get_memory_usage() and keeps the result for get_last_memory_usage() */
+         vector<index_memory_usage> update_memory_usage();
+         /** @return the result of the last update_memory_usage(), may be called from any thread */
+         vector<index_memory_usage> get_last_memory_usage()const;
+
+         /**
+          * Stops maintaining the deferrable secondary indexes of all indexes, e.g. while replaying. They are
+          * rebuilt from scratch when called with false.
+          */
+         void defer_secondary_indexes( bool defer );
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
@@ -88,7 +148,7 @@ namespace graphene { namespace db {
          void          remove( const object& obj ) { get_mutable_index(obj.id).remove( obj ); }
          template<typename T, typename Lambda>
          void modify( const T& obj, const Lambda& m ) {
-            get_mutable_index(obj.id).modify(obj,m);
+            modify_impl( obj, m, std::is_void< typename primary_index_of<T>::type >() );
          }
 
          ///@}
@@ -135,6 +195,9 @@ namespace graphene { namespace db {
          IndexType* add_index()
          {
             typedef typename IndexType::object_type ObjectType;
+            static_assert( std::is_void< typename primary_index_of<ObjectType>::type >::value
+                           || std::is_same< typename primary_index_of<ObjectType>::type, IndexType >::value,
+                           "Index type does not match GRAPHENE_DB_DECLARE_PRIMARY_INDEX" );
             if( _index[ObjectType::space_id].size() <= ObjectType::type_id  )
                 _index[ObjectType::space_id].resize( 255 );
             assert(!_index[ObjectType::space_id][ObjectType::type_id]);
@@ -153,6 +216,70 @@ namespace graphene { namespace db {
 
          fc::path get_data_dir()const { return _data_dir; }
 
+         /**
+          * @class read_snapshot
+          * @brief Lets a thread other than the one that modifies the database read the indexes consistently
+          *
+          * This is a writer-preferring reader-writer lock, not a multi-version snapshot. Every modification must
+          * happen inside a write_section. While a write section is pending new snapshots wait for it to end, and
+          * it waits for the existing snapshots to be released, so a reader never sees a state in the middle of
+          * e.g. a block. The thread that holds the write section may always read.
+          *
+          * Because the writer blocks its thread while it waits, readers should call check_read_time() in their
+          * loops, which aborts them once a write section has waited longer than set_max_read_time() allows.
+          */
+         class read_snapshot
+         {
+            public:
+               read_snapshot( read_snapshot&& mv ):_db(mv._db),_revision(mv._revision) { mv._db = nullptr; }
+               ~read_snapshot();
+
+               /** number of write sections that were completed when the snapshot was taken */
+               uint64_t revision()const { return _revision; }
+
+            private:
+               friend class object_database;
+               read_snapshot( const object_database* db, uint64_t revision ):_db(db),_revision(revision) {}
+               read_snapshot( const read_snapshot& ) = delete;
+               read_snapshot& operator=( const read_snapshot& ) = delete;
+
+               const object_database* _db;
+               uint64_t               _revision;
+         };
+
+         /**
+          * @class write_section
+          * @brief Excludes read snapshots while the database is modified, nested sections are no-ops
+          */
+         class write_section
+         {
+            public:
+               write_section( write_section&& mv ):_db(mv._db) { mv._db = nullptr; }
+               ~write_section();
+
+            private:
+               friend class object_database;
+               explicit write_section( object_database* db ):_db(db) {}
+               write_section( const write_section& ) = delete;
+               write_section& operator=( const write_section& ) = delete;
+
+               object_database* _db;
+         };
+
+         read_snapshot start_read_snapshot()const;
+         write_section start_write_section();
+
+         /**
+          * Bounds how long a pending write section waits for the readers that call check_read_time(),
+          * 0 lets readers run to completion.
+          */
+         void set_max_read_time( fc::microseconds max_time ) { _max_read_time = max_time.count(); }
+         /**
+          * Throws if the calling thread holds a read snapshot and a write section has been waiting for it longer
+          * than the maximum read time. Cheap enough to call once per iteration of a query loop.
+          */
+         void check_read_time()const;
+
          /** public for testing purposes only... should be private in practice. */
          undo_database                          _undo_db;
      protected:
@@ -167,6 +294,15 @@ namespace graphene { namespace db {
          index& get_mutable_index(uint8_t space_id, uint8_t type_id);
 
      private:
+         /** no primary_index_of declared for T, go through the virtual index::modify() */
+         template<typename T, typename Lambda>
+         void modify_impl( const T& obj, const Lambda& m, std::true_type ) {
+            get_mutable_index(obj.id).modify(obj,m);
+         }
+         template<typename T, typename Lambda>
+         void modify_impl( const T& obj, const Lambda& m, std::false_type ) {
+            get_mutable_index_type< typename primary_index_of<T>::type >().modify_inline(obj,m);
+         }
 
          friend class base_primary_index;
          friend class undo_database;
@@ -174,10 +310,40 @@ namespace graphene { namespace db {
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
 
+         void flush_full();
+         void flush_changes();
+
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+         /** (space, type) of the indexes covered by get_state_hash() */
+         std::set< std::pair<uint8_t,uint8_t> >                    _state_indexes;
+
+         mutable std::mutex                                        _snapshot_mutex;
+         mutable std::condition_variable                           _snapshot_cv;
+         mutable uint32_t                                          _active_snapshots = 0;
+         bool                                                      _writing = false;
+         std::thread::id                                           _writer_thread;
+         /** nesting level of write sections, only touched by the writing thread */
+         uint32_t                                                  _write_depth = 0;
+         uint64_t                                                  _revision = 0;
+         /** steady clock time in microseconds since a write section waits for readers, 0 if none does */
+         std::atomic<int64_t>                                      _write_pending_since{ 0 };
+         int64_t                                                   _max_read_time = 0;
+
+         bool                                                      _incremental_flush = false;
+         bool                                                      _track_state_hash = false;
+         uint32_t                                                  _compaction_interval = 100;
+         /** true if the files on disk plus the tracked changes equal the current state */
+         bool                                                      _changes_tracked = false;
+         /** number of delta batches committed since the last full flush */
+         uint64_t                                                  _delta_sequence = 0;
+
+         mutable std::mutex                                        _memory_usage_mutex;
+         vector<index_memory_usage>                                _last_memory_usage;
    };
 
 } } // graphene::db
 
+FC_REFLECT( graphene::db::index_memory_usage, (space_id)(type_id)(object_count)(fixed_bytes)(member_bytes)(secondary_bytes) )
+
 
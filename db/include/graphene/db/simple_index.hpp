@@ -59,6 +59,14 @@ namespace graphene { namespace db {
             modify_callback( *_objects[obj.id.instance()] );
          }
 
+         /** modify() without type erasure, modify_callback is called inline with a T& */
+         template<typename Lambda>
+         void modify_inline( const object& obj, Lambda&& modify_callback )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            modify_callback( static_cast<T&>( *_objects[obj.id.instance()] ) );
+         }
+
          virtual const object& insert( object&& obj )override
          {
             auto instance = obj.id.instance();
@@ -69,6 +77,11 @@ namespace graphene { namespace db {
             return *_objects[instance];
          }
 
+         virtual void reserve( size_t count ) override
+         {
+            _objects.reserve( count );
+         }
+
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
@@ -88,6 +101,19 @@ namespace graphene { namespace db {
             return _objects[instance].get();
          }
 
+         virtual uint64_t get_object_count()const override
+         {
+            uint64_t count = 0;
+            for( const auto& ptr : _objects )
+               if( ptr ) ++count;
+            return count;
+         }
+
+         virtual uint64_t get_object_memory_usage()const override
+         {
+            return _objects.capacity() * sizeof( unique_ptr<object> ) + get_object_count() * sizeof( T );
+         }
+
          virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
          {
             try {
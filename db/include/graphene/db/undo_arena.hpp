@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/object.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class undo_arena
+    * @brief Bump allocator for the object copies held by an undo_state
+    *
+    * Copies are constructed back to back in large blocks which are all released at once when the arena is
+    * destroyed. The arena does not keep track of what it allocated, the owner must call destroy() on every
+    * copy it obtained from clone() before the arena goes away.
+    */
+   class undo_arena
+   {
+      public:
+         undo_arena() = default;
+         undo_arena( const undo_arena& ) = delete;
+         undo_arena& operator=( const undo_arena& ) = delete;
+         undo_arena( undo_arena&& other )
+         :_blocks( std::move(other._blocks) ),_pos(other._pos),_end(other._end)
+         {
+            other._blocks.clear();
+            other._pos = other._end = nullptr;
+         }
+
+         /** @return a copy of obj that lives inside the arena */
+         object* clone( const object& obj )
+         {
+            return obj.clone_into( allocate( obj.object_size() ) );
+         }
+
+         /** runs the destructor of a copy returned by clone(), its memory is reclaimed together with the arena */
+         static void destroy( object* obj ) { obj->~object(); }
+
+         /** takes over all blocks of other, used when undo states are merged */
+         void splice( undo_arena& other )
+         {
+            _blocks.reserve( _blocks.size() + other._blocks.size() );
+            for( auto& block : other._blocks )
+               _blocks.emplace_back( std::move(block) );
+            other._blocks.clear();
+            other._pos = other._end = nullptr;
+         }
+
+      private:
+         static const size_t block_size = 64 * 1024;
+         static const size_t alignment  = alignof(std::max_align_t);
+
+         void* allocate( size_t size )
+         {
+            size = ( size + alignment - 1 ) & ~( alignment - 1 );
+            if( size > block_size / 4 )
+            {
+               // large objects get a block of their own so that the current block is not wasted
+               _blocks.emplace_back( new char[size] );
+               return _blocks.back().get();
+            }
+            if( size_t( _end - _pos ) < size )
+            {
+               _blocks.emplace_back( new char[block_size] );
+               _pos = _blocks.back().get();
+               _end = _pos + block_size;
+            }
+            void* result = _pos;
+            _pos += size;
+            return result;
+         }
+
+         std::vector< std::unique_ptr<char[]> > _blocks;
+         char*                                  _pos = nullptr;
+         char*                                  _end = nullptr;
+   };
+
+} } // graphene::db
@@ -23,6 +23,8 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/flat_id_map.hpp>
+#include <graphene/db/undo_arena.hpp>
 #include <deque>
 #include <fc/exception/exception.hpp>
 
@@ -32,12 +34,21 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   /**
+    * The copies referenced by old_values and removed are owned by the state and live in its arena,
+    * they are destroyed together with the state.
+    */
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      undo_state() = default;
+      undo_state( undo_state&& ) = default;
+      ~undo_state();
+
+      flat_id_map<object*>        old_values;
+      flat_id_map<object_id_type> old_index_next_ids;
+      flat_id_set                 new_ids;
+      flat_id_map<object*>        removed;
+      undo_arena                  arena;
    };
 
 
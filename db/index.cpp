@@ -32,12 +32,29 @@ namespace graphene { namespace db {
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
+      if( _track_changes )
+      {
+         _removed_ids.erase( obj.id );
+         _changed_ids.insert( obj.id );
+      }
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   {
+      _db.save_undo_remove( obj );
+      if( _track_changes )
+      {
+         _changed_ids.erase( obj.id );
+         _removed_ids.insert( obj.id );
+      }
+      for( auto ob : _observers ) ob->on_remove( obj );
+   }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
+   {
+      if( _track_changes )
+         _changed_ids.insert( obj.id );
+      for( auto ob : _observers ) ob->on_modify(  obj );
+   }
 } } // graphene::chain
@@ -24,9 +24,12 @@
 #include <graphene/db/object_database.hpp>
 
 #include <fc/io/raw.hpp>
+#include <fc/io/fstream.hpp>
 #include <fc/container/flat.hpp>
 #include <fc/thread/parallel.hpp>
 
+#include <chrono>
+
 namespace graphene { namespace db {
 
 object_database::object_database()
@@ -68,7 +71,99 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
    return *idx;
 }
 
+void object_database::set_incremental_flush( bool enable, uint32_t compaction_interval )
+{
+   _incremental_flush = enable;
+   _compaction_interval = compaction_interval;
+}
+
+void object_database::mark_state_indexes( const std::set< std::pair<uint8_t,uint8_t> >& excluded )
+{
+   _state_indexes.clear();
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] && !excluded.count( std::make_pair( uint8_t(space), uint8_t(type) ) ) )
+            _state_indexes.emplace( space, type );
+   if( _track_state_hash )
+      for( const auto& item : _state_indexes )
+         _index[item.first][item.second]->enable_state_hash();
+}
+
+void object_database::enable_state_hash_tracking()
+{
+   _track_state_hash = true;
+   for( const auto& item : _state_indexes )
+      _index[item.first][item.second]->enable_state_hash();
+}
+
+fc::sha256 object_database::get_state_hash()const
+{
+   fc::sha256::encoder enc;
+   for( const auto& item : _state_indexes )
+   {
+      fc::raw::pack( enc, item.first );
+      fc::raw::pack( enc, item.second );
+      fc::raw::pack( enc, get_index( item.first, item.second ).get_state_hash() );
+   }
+   return enc.result();
+}
+
+fc::sha256 object_database::get_index_state_hash( uint8_t space_id, uint8_t type_id )const
+{
+   return get_index( space_id, type_id ).get_state_hash();
+}
+
+vector<index_memory_usage> object_database::get_memory_usage()const
+{
+   vector<index_memory_usage> result;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+         {
+            const auto& idx = *_index[space][type];
+            index_memory_usage usage;
+            usage.space_id        = space;
+            usage.type_id         = type;
+            usage.object_count    = idx.get_object_count();
+            usage.fixed_bytes     = idx.get_object_memory_usage();
+            usage.member_bytes    = idx.get_member_memory_usage();
+            usage.secondary_bytes = idx.get_secondary_memory_usage();
+            result.push_back( usage );
+         }
+   return result;
+}
+
+vector<index_memory_usage> object_database::update_memory_usage()
+{
+   auto usage = get_memory_usage();
+   std::lock_guard<std::mutex> lock( _memory_usage_mutex );
+   _last_memory_usage = usage;
+   return usage;
+}
+
+vector<index_memory_usage> object_database::get_last_memory_usage()const
+{
+   std::lock_guard<std::mutex> lock( _memory_usage_mutex );
+   return _last_memory_usage;
+}
+
+void object_database::defer_secondary_indexes( bool defer )
+{
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+            _index[space][type]->defer_secondary_indexes( defer );
+}
+
 void object_database::flush()
+{
+   if( _incremental_flush && _changes_tracked && _delta_sequence < _compaction_interval )
+      flush_changes();
+   else
+      flush_full();
+}
+
+void object_database::flush_full()
 {
 //   ilog("Save object_database in ${d}", ("d", _data_dir));
    fc::create_directories( _data_dir / "object_database.tmp" / "lock" );
@@ -91,11 +186,67 @@ void object_database::flush()
       fc::rename( _data_dir / "object_database", _data_dir / "object_database.old" );
    fc::rename( _data_dir / "object_database.tmp", _data_dir / "object_database" );
    fc::remove_all( _data_dir / "object_database.old" );
+
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+            _index[space][type]->set_change_tracking( _incremental_flush );
+   _changes_tracked = _incremental_flush;
+   _delta_sequence = 0;
 }
 
+void object_database::flush_changes()
+{ try {
+   const fc::path dir = _data_dir / "object_database";
+   const uint64_t sequence = _delta_sequence + 1;
+   std::vector<fc::future<void>> tasks;
+   tasks.reserve(200);
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+            tasks.push_back( fc::do_parallel( [this,&dir,space,type,sequence] () {
+               _index[space][type]->save_changes( dir / fc::to_string(space) / (fc::to_string(type) + ".delta"), sequence );
+            } ) );
+   for( auto& task : tasks )
+      task.wait();
+
+   // the batch only becomes visible to open() once the new sequence number is on disk
+   {
+      std::ofstream out( (dir / "delta_sequence.tmp").generic_string(),
+                         std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      out << sequence;
+      out.flush();
+      FC_ASSERT( out, "Failed to write delta sequence" );
+   }
+   fc::rename( dir / "delta_sequence.tmp", dir / "delta_sequence" );
+   _delta_sequence = sequence;
+
+   // compact early once the delta logs have grown larger than the snapshot itself
+   uint64_t snapshot_size = 0;
+   uint64_t delta_size = 0;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+         {
+            const fc::path file = dir / fc::to_string(space) / fc::to_string(type);
+            if( fc::exists( file ) )
+               snapshot_size += fc::file_size( file );
+            const fc::path log = dir / fc::to_string(space) / (fc::to_string(type) + ".delta");
+            if( fc::exists( log ) )
+               delta_size += fc::file_size( log );
+         }
+   if( delta_size > snapshot_size )
+      _delta_sequence = _compaction_interval;
+} catch( ... ) {
+   // some indexes may have dropped their tracked changes already, only a full flush is safe now
+   _changes_tracked = false;
+   throw;
+} }
+
 void object_database::wipe(const fc::path& data_dir)
 {
    close();
+   _changes_tracked = false;
    ilog("Wiping object database...");
    fc::remove_all(data_dir / "object_database");
    ilog("Done wiping object databse.");
@@ -109,22 +260,115 @@ void object_database::open(const fc::path& data_dir)
        wlog("Ignoring locked object_database");
        return;
    }
+   _delta_sequence = 0;
+   if( fc::exists( _data_dir / "object_database" / "delta_sequence" ) )
+   {
+      std::string sequence;
+      fc::read_file_contents( _data_dir / "object_database" / "delta_sequence", sequence );
+      _delta_sequence = std::stoull( sequence );
+   }
+
    std::vector<fc::future<void>> tasks;
    tasks.reserve(200);
+   bool snapshot_missing = false;
    ilog("Opening object database from ${d} ...", ("d", data_dir));
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            tasks.push_back( fc::do_parallel( [this,space,type] () {
-               _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+         {
+            const fc::path dir = _data_dir / "object_database" / fc::to_string(space);
+            // a delta log only holds the changes since the snapshot, without it the index starts empty
+            const bool has_snapshot = fc::exists( dir / fc::to_string(type) );
+            if( !has_snapshot && fc::exists( dir / (fc::to_string(type) + ".delta") ) )
+               wlog( "Ignoring delta log of index ${s}.${t} which has no snapshot", ("s",space)("t",type) );
+            snapshot_missing = snapshot_missing || !has_snapshot;
+            tasks.push_back( fc::do_parallel( [this,dir,space,type,has_snapshot] () {
+               if( has_snapshot )
+               {
+                  _index[space][type]->open( dir / fc::to_string(type) );
+                  _index[space][type]->open_changes( dir / (fc::to_string(type) + ".delta"), _delta_sequence );
+               }
+               _index[space][type]->set_change_tracking( _incremental_flush );
             } ) );
+         }
    for( auto& task : tasks )
       task.wait();
+   // the next flush has to write a snapshot of every index before changes can be logged again
+   _changes_tracked = _incremental_flush && fc::exists( _data_dir / "object_database" ) && !snapshot_missing;
    ilog( "Done opening object database." );
 
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
 
+namespace {
+   /** read snapshots held by the current thread, nested ones must not wait for a pending write section */
+   thread_local uint32_t snapshots_held = 0;
+
+   int64_t steady_microseconds()
+   {
+      return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+   }
+}
+
+object_database::read_snapshot::~read_snapshot()
+{
+   if( _db == nullptr ) return;
+   --snapshots_held;
+   std::lock_guard<std::mutex> lock( _db->_snapshot_mutex );
+   if( --_db->_active_snapshots == 0 )
+      _db->_snapshot_cv.notify_all();
+}
+
+object_database::write_section::~write_section()
+{
+   if( _db == nullptr || --_db->_write_depth > 0 ) return;
+   std::lock_guard<std::mutex> lock( _db->_snapshot_mutex );
+   _db->_writing = false;
+   _db->_writer_thread = std::thread::id();
+   ++_db->_revision;
+   _db->_snapshot_cv.notify_all();
+}
+
+object_database::read_snapshot object_database::start_read_snapshot()const
+{
+   std::unique_lock<std::mutex> lock( _snapshot_mutex );
+   if( _writing && _writer_thread == std::this_thread::get_id() )
+      return read_snapshot( nullptr, _revision );
+   if( snapshots_held == 0 )
+      _snapshot_cv.wait( lock, [this]() { return !_writing; } );
+   ++_active_snapshots;
+   ++snapshots_held;
+   return read_snapshot( this, _revision );
+}
+
+object_database::write_section object_database::start_write_section()
+{
+   if( _write_depth++ > 0 ) return write_section( this );
+   std::unique_lock<std::mutex> lock( _snapshot_mutex );
+   _writing = true;
+   _writer_thread = std::this_thread::get_id();
+   if( _active_snapshots > 0 )
+   {
+      _write_pending_since = steady_microseconds();
+      _snapshot_cv.wait( lock, [this]() { return _active_snapshots == 0; } );
+      _write_pending_since = 0;
+   }
+   return write_section( this );
+}
+
+void object_database::check_read_time()const
+{
+   if( snapshots_held == 0 || _max_read_time == 0 )
+      return;
+   const int64_t pending_since = _write_pending_since.load( std::memory_order_relaxed );
+   if( pending_since == 0 )
+      return;
+   const int64_t waited = steady_microseconds() - pending_since;
+   FC_ASSERT( waited <= _max_read_time,
+              "Query aborted after block processing waited ${ms} ms for it", ("ms", waited / 1000) );
+}
+
 void object_database::pop_undo()
 { try {
    _undo_db.pop_commit();
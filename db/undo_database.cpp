@@ -27,6 +27,14 @@
 
 namespace graphene { namespace db {
 
+undo_state::~undo_state()
+{
+   for( auto& item : old_values )
+      undo_arena::destroy( item.second );
+   for( auto& item : removed )
+      undo_arena::destroy( item.second );
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -81,7 +89,7 @@ void undo_database::on_modify( const object& obj )
       return;
    auto itr =  state.old_values.find(obj.id);
    if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   state.old_values.emplace( obj.id, state.arena.clone( obj ) );
 }
 void undo_database::on_remove( const object& obj )
 {
@@ -95,14 +103,16 @@ void undo_database::on_remove( const object& obj )
       state.new_ids.erase(obj.id);
       return;
    }
-   if( state.old_values.count(obj.id) )
+   auto itr = state.old_values.find(obj.id);
+   if( itr != state.old_values.end() )
    {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
+      object* old_value = itr->second;
       state.old_values.erase(obj.id);
+      state.removed.emplace( obj.id, old_value );
       return;
    }
    if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   state.removed.emplace( obj.id, state.arena.clone( obj ) );
 }
 
 void undo_database::undo()
@@ -193,20 +203,22 @@ void undo_database::merge()
    // *+upd
    for( auto& obj : state.old_values )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.find(obj.first) != prev_state.new_ids.end() )
       {
          // new+upd -> new, type A
+         undo_arena::destroy( obj.second );
          continue;
       }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
+      if( prev_state.old_values.find(obj.first) != prev_state.old_values.end() )
       {
          // upd(was=X) + upd(was=Y) -> upd(was=X), type A
+         undo_arena::destroy( obj.second );
          continue;
       }
       // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
+      assert( prev_state.removed.find(obj.first) == prev_state.removed.end() );
       // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
+      prev_state.old_values.emplace( obj.first, obj.second );
    }
 
    // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
@@ -233,25 +245,33 @@ void undo_database::merge()
    // *+del
    for( auto& obj : state.removed )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.find(obj.first) != prev_state.new_ids.end() )
       {
          // new + del -> nop (type C)
-         prev_state.new_ids.erase(obj.second->id);
+         prev_state.new_ids.erase(obj.first);
+         undo_arena::destroy( obj.second );
          continue;
       }
-      auto it = prev_state.old_values.find(obj.second->id);
+      auto it = prev_state.old_values.find(obj.first);
       if( it != prev_state.old_values.end() )
       {
          // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
+         object* old_value = it->second;
+         prev_state.old_values.erase(obj.first);
+         prev_state.removed.emplace( obj.first, old_value );
+         undo_arena::destroy( obj.second );
          continue;
       }
       // del + del -> N/A
-      assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
+      assert( prev_state.removed.find( obj.first ) == prev_state.removed.end() );
       // nop + del(was=Y) -> del(was=Y)
-      prev_state.removed[obj.second->id] = std::move(obj.second);
+      prev_state.removed.emplace( obj.first, obj.second );
    }
+
+   // every copy of state has been either destroyed or handed over to prev_state, whose arena now keeps the memory
+   state.old_values.clear();
+   state.removed.clear();
+   prev_state.arena.splice( state.arena );
    _stack.pop_back();
    --_active_sessions;
 }
@@ -79,6 +79,16 @@ namespace graphene { namespace net {
           */
          virtual bool handle_block( const graphene::net::block_message& blk_msg, bool sync_mode, 
                                     std::vector<fc::uint160_t>& contained_transaction_message_ids ) = 0;
+
+         /**
+          *  @brief Called when a block is received during sync, before it is queued for handle_block()
+          *
+          *  Lets the delegate start expensive work for the block, e.g. signature recovery, in the background
+          *  while earlier blocks are still being applied. Unlike the other methods it is called directly on the
+          *  p2p thread, so that it never waits for a block being applied; it must not touch the chain state and
+          *  must return quickly.
+          */
+         virtual void prefetch_sync_block( const graphene::net::block_message& blk_msg ) = 0;
          
          /**
           *  @brief Called when a new transaction comes in from the network
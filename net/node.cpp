@@ -2883,6 +2883,15 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
+      try
+      {
+        _delegate->prefetch_sync_block( block_message_to_process );
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "Failed to prefetch sync block: ${e}", ("e", e.to_detail_string()) );
+      }
+
       // add it to the front of _received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
       _new_received_sync_items.push_front( block_message_to_process );
@@ -5036,6 +5045,12 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(handle_block, block_message, sync_mode, contained_transaction_message_ids);
     }
 
+    void statistics_gathering_node_delegate_wrapper::prefetch_sync_block( const graphene::net::block_message& block_message )
+    {
+      // not marshalled to the delegate's thread, which is busy applying blocks during sync
+      _node_delegate->prefetch_sync_block( block_message );
+    }
+
     void statistics_gathering_node_delegate_wrapper::handle_transaction( const graphene::net::trx_message& transaction_message )
     {
       INVOKE_AND_COLLECT_STATISTICS(handle_transaction, transaction_message);
@@ -285,7 +285,7 @@ void grouped_orders_plugin::plugin_initialize(const boost::program_options::vari
    else
       my->_tracked_groups = fc::json::from_string("[10,100]").as<flat_set<uint16_t>>(2);
 
-   database().add_secondary_index< primary_index<limit_order_index>, detail::limit_order_group_index >( my->_tracked_groups );
+   database().add_secondary_index< primary_index<limit_order_index, hashed_ids>, detail::limit_order_group_index >( my->_tracked_groups );
 
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -301,7 +301,7 @@ const flat_set<uint16_t>& grouped_orders_plugin::tracked_groups() const
 const map< limit_order_group_key, limit_order_group_data >& grouped_orders_plugin::limit_order_groups()
 {
    const auto& idx = database().get_index_type< limit_order_index >();
-   const auto& pidx = dynamic_cast<const primary_index< limit_order_index >&>(idx);
+   const auto& pidx = dynamic_cast<const primary_index< limit_order_index, hashed_ids >&>(idx);
    const auto& logidx = pidx.get_secondary_index< detail::limit_order_group_index >();
    return logidx.get_order_groups();
 }
@@ -114,7 +114,7 @@ static void create_snapshot( const graphene::chain::database& db, const fc::path
          });
       }
    out.close();
-   ilog("snapshot plugin: created snapshot");
+   ilog( "snapshot plugin: created snapshot, state hash ${h}", ("h",db.get_state_hash()) );
 }
 
 void snapshot_plugin::check_snapshot( const graphene::chain::signed_block& b )
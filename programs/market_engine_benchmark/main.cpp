@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Measures the order matching functions of the chain database on synthetic markets.
+ *
+ * A fresh database is filled with a configurable number of markets, each trading a market pegged asset
+ * against the core asset, with limit orders on both sides, call orders and force settlements. Then every
+ * workload calls one function of the market engine in a loop and reports its throughput and latency
+ * percentiles, so that changes to the matching logic can be compared by their numbers.
+ */
+
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/global_property_object.hpp>
+#include <graphene/chain/market_object.hpp>
+#include <graphene/protocol/fee_schedule.hpp>
+#include <graphene/utilities/tempdir.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/crypto/elliptic.hpp>
+
+#include <boost/multiprecision/integer.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace graphene::chain;
+
+namespace {
+
+/**
+ * Latency distribution of one benchmarked function. Samples are counted in 8 buckets per power of two, so
+ * the reported percentiles are accurate to about 10%.
+ */
+class latency_histogram
+{
+   public:
+      template<typename Call>
+      void measure( Call&& call )
+      {
+         const auto start = std::chrono::steady_clock::now();
+         call();
+         record( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start ).count() );
+      }
+
+      void record( uint64_t nanoseconds )
+      {
+         ++_count;
+         _total_ns += nanoseconds;
+         _max_ns = std::max( _max_ns, nanoseconds );
+         ++_buckets[ bucket_of( nanoseconds ) ];
+      }
+
+      /// @return the upper bound of the bucket that holds the given fraction of the samples
+      uint64_t percentile( double fraction )const
+      {
+         const uint64_t rank = uint64_t( _count * fraction );
+         uint64_t seen = 0;
+         for( uint32_t i = 0; i < _buckets.size(); ++i )
+         {
+            seen += _buckets[i];
+            if( seen > rank )
+               return std::min( bucket_limit( i ), _max_ns );
+         }
+         return _max_ns;
+      }
+
+      void print( const std::string& name )const
+      {
+         std::cout << std::left << std::setw( 22 ) << name << std::right
+                   << std::setw( 10 ) << _count
+                   << std::setw( 12 ) << _total_ns / 1000000
+                   << std::setw( 12 ) << uint64_t( _count * 1000000000.0 / std::max<uint64_t>( _total_ns, 1 ) )
+                   << std::setw( 10 ) << ( _count ? _total_ns / _count : 0 )
+                   << std::setw( 10 ) << percentile( 0.5 )
+                   << std::setw( 10 ) << percentile( 0.9 )
+                   << std::setw( 10 ) << percentile( 0.99 )
+                   << std::setw( 12 ) << _max_ns << "\n";
+      }
+
+      static void print_header()
+      {
+         std::cout << std::left << std::setw( 22 ) << "function" << std::right
+                   << std::setw( 10 ) << "calls" << std::setw( 12 ) << "total ms" << std::setw( 12 ) << "ops/s"
+                   << std::setw( 10 ) << "mean ns" << std::setw( 10 ) << "p50 ns" << std::setw( 10 ) << "p90 ns"
+                   << std::setw( 10 ) << "p99 ns" << std::setw( 12 ) << "max ns" << "\n";
+      }
+
+   private:
+      static const uint32_t sub_buckets = 8;
+
+      static uint32_t bucket_of( uint64_t nanoseconds )
+      {
+         if( nanoseconds < sub_buckets )
+            return nanoseconds;
+         // the leading bit selects the power of two, the next 3 bits the bucket within it
+         uint32_t exponent = boost::multiprecision::msb( nanoseconds );
+         return ( exponent - 2 ) * sub_buckets + ( ( nanoseconds >> ( exponent - 3 ) ) & ( sub_buckets - 1 ) );
+      }
+
+      static uint64_t bucket_limit( uint32_t bucket )
+      {
+         if( bucket < sub_buckets )
+            return bucket;
+         uint32_t exponent = bucket / sub_buckets + 2;
+         return ( uint64_t( sub_buckets + bucket % sub_buckets + 1 ) << ( exponent - 3 ) ) - 1;
+      }
+
+      uint64_t                                   _count = 0;
+      uint64_t                                   _total_ns = 0;
+      uint64_t                                   _max_ns = 0;
+      std::array< uint64_t, 64 * sub_buckets >   _buckets{};
+};
+
+struct benchmark_config
+{
+   uint32_t accounts      = 1000;
+   uint32_t markets       = 10;
+   uint32_t limit_orders  = 2000;  ///< per market, half on each side
+   uint32_t call_orders   = 200;   ///< per market, at most one per account
+   uint32_t settle_orders = 50;    ///< per market
+   uint32_t rounds        = 10000; ///< calls per workload
+   uint64_t seed          = 1;
+   bool     undo          = false; ///< run every round in an undo session, like a block
+};
+
+/// seconds of chain time the clear_expired_orders workload walks through, expirations are spread over them
+const uint32_t simulated_seconds = 2 * GRAPHENE_DEFAULT_FORCE_SETTLEMENT_DELAY;
+/// amount of a market pegged asset that the feeds price
+const int64_t  feed_unit = 1000000;
+
+genesis_state_type make_genesis( uint32_t accounts )
+{
+   const auto key = fc::ecc::private_key::regenerate( fc::sha256::hash( std::string( "benchmark" ) ) )
+                       .get_public_key();
+   genesis_state_type genesis;
+   genesis.initial_parameters.get_mutable_fees() = fee_schedule::get_default();
+   genesis.initial_active_witnesses = GRAPHENE_DEFAULT_MIN_WITNESS_COUNT;
+   // start at the current time, so that the current matching rules apply
+   genesis.initial_timestamp = time_point_sec( fc::time_point::now().sec_since_epoch() /
+         genesis.initial_parameters.block_interval * genesis.initial_parameters.block_interval );
+   for( uint64_t i = 0; i < genesis.initial_active_witnesses; ++i )
+   {
+      const std::string name = "init" + std::to_string( i );
+      genesis.initial_accounts.emplace_back( name, key, key, true );
+      genesis.initial_committee_candidates.push_back( { name } );
+      genesis.initial_witness_candidates.push_back( { name, key } );
+   }
+   for( uint32_t i = 0; i < accounts; ++i )
+      genesis.initial_accounts.emplace_back( "trader" + std::to_string( i ), key );
+   genesis.initial_chain_id = fc::sha256::hash( std::string( "market engine benchmark" ) );
+   return genesis;
+}
+
+std::string market_symbol( uint32_t market )
+{
+   std::string symbol = "BENCH";
+   do
+   {
+      symbol += char( 'A' + market % 26 );
+      market /= 26;
+   } while( market > 0 );
+   return symbol;
+}
+
+class market_engine_benchmark
+{
+   public:
+      market_engine_benchmark( database& db, const benchmark_config& config )
+         : _db( db ), _config( config ), _rng( config.seed ) {}
+
+      /** Creates the traders' balances, the markets and their orders directly, without evaluators */
+      void build_markets()
+      {
+         _db._undo_db.disable();
+
+         const auto& dgp = _db.get_dynamic_global_properties();
+         _start = dgp.time;
+         // hard fork checks in the market engine compare against the next maintenance time
+         _db.modify( dgp, [this]( dynamic_global_property_object& p ) {
+            p.next_maintenance_time = _start + _db.get_global_properties().parameters.maintenance_interval;
+         } );
+
+         const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
+         const share_type core_per_trader = GRAPHENE_MAX_SHARE_SUPPLY / 2 / _config.accounts;
+         _db.adjust_balance( GRAPHENE_COMMITTEE_ACCOUNT, -asset( core_per_trader * _config.accounts ) );
+         for( uint32_t i = 0; i < _config.accounts; ++i )
+         {
+            const account_id_type trader = accounts_by_name.find( "trader" + std::to_string( i ) )->id;
+            _traders.push_back( trader );
+            _db.adjust_balance( trader, asset( core_per_trader ) );
+         }
+
+         for( uint32_t i = 0; i < _config.markets; ++i )
+            _markets.push_back( build_market( market_symbol( i ) ).id );
+
+         if( _config.undo )
+            _db._undo_db.enable();
+      }
+
+      /** New limit orders crossing the top of a random book, alternately buying and selling */
+      void run_apply_order()
+      {
+         latency_histogram histogram;
+         for( uint32_t r = 0; r < _config.rounds; ++r )
+            run_round( [&]() {
+               const asset_object& mia = random_market();
+               const share_type amount = random_amount( 1000, 100000 );
+               const limit_order_object* order;
+               if( r % 2 == 0 )
+                  order = &create_order( random_trader(), asset( amount ),
+                                         scaled( amount, 1 / random_real( 1.0, 1.02 ), mia.id ),
+                                         time_point_sec::maximum() );
+               else
+                  order = &create_order( random_trader(), asset( amount, mia.id ),
+                                         scaled( amount, random_real( 0.97, 0.99 ), asset_id_type() ),
+                                         time_point_sec::maximum() );
+               histogram.measure( [&]() { _db.apply_order( *order ); } );
+            } );
+         histogram.print( "apply_order" );
+      }
+
+      /** A new order takes a quarter of the best ask of a random market at its price */
+      void run_match()
+      {
+         latency_histogram histogram;
+         for( uint32_t r = 0; r < _config.rounds; ++r )
+            run_round( [&]() {
+               const asset_object& mia = random_market();
+               const limit_order_object* maker = order_book().get_best_order( mia.id, asset_id_type() );
+               if( maker == nullptr )
+                  return;
+               const asset pays( std::max<int64_t>( 1, maker->amount_to_receive().amount.value / 4 ) );
+               const asset receives = pays * maker->sell_price;
+               if( receives.amount == 0 )
+                  return;
+               const limit_order_object& taker = create_order( random_trader(), pays, receives,
+                                                                time_point_sec::maximum() );
+               const limit_order_id_type taker_id = taker.id;
+               const price match_price = maker->sell_price;
+               histogram.measure( [&]() { _db.match( taker, *maker, match_price ); } );
+               // a taker left over by rounding would cross the book
+               if( const limit_order_object* left = _db.find( taker_id ) )
+                  _db.cancel_limit_order( *left, false );
+            } );
+         histogram.print( "match" );
+      }
+
+      /** Fills a quarter of the best order on a random side of a random market, without a counterpart */
+      void run_fill_limit_order()
+      {
+         latency_histogram histogram;
+         for( uint32_t r = 0; r < _config.rounds; ++r )
+            run_round( [&]() {
+               const asset_object& mia = random_market();
+               const limit_order_object* order = ( r % 2 == 0 )
+                     ? order_book().get_best_order( mia.id, asset_id_type() )
+                     : order_book().get_best_order( asset_id_type(), mia.id );
+               if( order == nullptr )
+                  return;
+               const asset pays( std::max<int64_t>( 1, order->for_sale.value / 4 ), order->sell_asset_id() );
+               const asset receives = pays * order->sell_price;
+               if( receives.amount == 0 )
+                  return;
+               histogram.measure( [&]() {
+                  _db.fill_limit_order( *order, pays, receives, true, order->sell_price, true );
+               } );
+            } );
+         histogram.print( "fill_limit_order" );
+      }
+
+      /**
+       * Raises the feed of the markets in turns by up to 30%, so that more and more call orders fall below the
+       * maintenance collateral ratio and are margin called against the asks
+       */
+      void run_check_call_orders()
+      {
+         latency_histogram histogram;
+         const uint32_t steps = std::max<uint32_t>( 1, _config.rounds / _markets.size() );
+         for( uint32_t r = 0; r < _config.rounds; ++r )
+            run_round( [&]() {
+               const asset_object& mia = _markets[ r % _markets.size() ]( _db );
+               const double feed = 1.0 + 0.3 * std::min<uint32_t>( r / _markets.size() + 1, steps ) / steps;
+               publish_feed( mia, price( asset( feed_unit, mia.id ), scaled( feed_unit, feed, asset_id_type() ) ) );
+               histogram.measure( [&]() { _db.check_call_orders( mia ); } );
+            } );
+         histogram.print( "check_call_orders" );
+      }
+
+      /** Walks the chain time through the expirations of the limit orders and the settlement dates */
+      void run_clear_expired_orders()
+      {
+         latency_histogram histogram;
+         const uint32_t step = std::max<uint32_t>( 1, simulated_seconds / _config.rounds );
+         for( uint32_t r = 0; r < _config.rounds; ++r )
+            run_round( [&]() {
+               _db.modify( _db.get_dynamic_global_properties(), [step]( dynamic_global_property_object& p ) {
+                  p.time += step;
+               } );
+               histogram.measure( [&]() { _db.clear_expired_orders(); } );
+            } );
+         histogram.print( "clear_expired_orders" );
+      }
+
+   private:
+      const asset_object& build_market( const std::string& symbol )
+      {
+         const asset_id_type asset_id = _db.get_index_type<asset_index>().get_next_id();
+         const auto& bitasset = _db.create<asset_bitasset_data_object>( [asset_id]( asset_bitasset_data_object& b ) {
+            b.asset_id = asset_id;
+            b.options.short_backing_asset = asset_id_type();
+            b.options.minimum_feeds = 1;
+            // the feed must not expire while the clear_expired_orders workload advances the chain time
+            b.options.feed_lifetime_sec = 2 * simulated_seconds;
+         } );
+         const auto& dynamic_data = _db.create<asset_dynamic_data_object>( []( asset_dynamic_data_object& ) {} );
+         const asset_object& mia = _db.create<asset_object>( [&]( asset_object& a ) {
+            a.symbol = symbol;
+            a.issuer = GRAPHENE_COMMITTEE_ACCOUNT;
+            a.options.max_supply = GRAPHENE_MAX_SHARE_SUPPLY;
+            a.options.core_exchange_rate = price( asset( 1, asset_id ), asset( 1 ) );
+            a.dynamic_asset_data_id = dynamic_data.id;
+            a.bitasset_data_id = bitasset.id;
+         } );
+
+         publish_feed( mia, price( asset( feed_unit, mia.id ), asset( feed_unit ) ) );
+
+         share_type supply = 0;
+         const share_type mpa_per_trader = 1000000000;
+         for( const account_id_type& trader : _traders )
+            _db.adjust_balance( trader, asset( mpa_per_trader, mia.id ) );
+         supply += mpa_per_trader * _traders.size();
+
+         // call orders of distinct borrowers, collateralized 2 to 4 times at the initial feed
+         std::vector<account_id_type> borrowers = _traders;
+         std::shuffle( borrowers.begin(), borrowers.end(), _rng );
+         for( uint32_t i = 0; i < _config.call_orders; ++i )
+         {
+            const asset debt( random_amount( 10000, 1000000 ), mia.id );
+            const asset collateral = scaled( debt.amount, random_real( 2.0, 4.0 ), asset_id_type() );
+            _db.modify( borrowers[i]( _db ).statistics( _db ), [&collateral]( account_statistics_object& s ) {
+               s.total_core_in_orders += collateral.amount;
+            } );
+            _db.adjust_balance( borrowers[i], -collateral );
+            _db.adjust_balance( borrowers[i], debt );
+            supply += debt.amount;
+            _db.create<call_order_object>( [&]( call_order_object& c ) {
+               c.borrower = borrowers[i];
+               c.collateral = collateral.amount;
+               c.debt = debt.amount;
+               c.call_price = price::call_price( debt, collateral, GRAPHENE_DEFAULT_MAINTENANCE_COLLATERAL_RATIO );
+            } );
+         }
+
+         // asks between 1.00 and 1.20, bids between 0.80 and 0.99 core per unit of the feed
+         for( uint32_t i = 0; i < _config.limit_orders; ++i )
+         {
+            const share_type amount = random_amount( 1000, 100000 );
+            const time_point_sec expiration = random_expiration();
+            if( i % 2 == 0 )
+               create_order( random_trader(), asset( amount, mia.id ),
+                             scaled( amount, random_real( 1.0, 1.2 ), asset_id_type() ), expiration );
+            else
+               create_order( random_trader(), asset( amount ),
+                             scaled( amount, 1 / random_real( 0.8, 0.99 ), mia.id ), expiration );
+         }
+
+         for( uint32_t i = 0; i < _config.settle_orders; ++i )
+         {
+            const account_id_type owner = random_trader();
+            const asset balance( random_amount( 1000, 100000 ), mia.id );
+            const time_point_sec settlement_date = random_expiration();
+            _db.adjust_balance( owner, -balance );
+            _db.create<force_settlement_object>( [&]( force_settlement_object& s ) {
+               s.owner = owner;
+               s.balance = balance;
+               s.settlement_date = settlement_date;
+            } );
+         }
+
+         _db.modify( dynamic_data, [supply]( asset_dynamic_data_object& d ) {
+            d.current_supply = supply;
+         } );
+         return mia;
+      }
+
+      /** Does what limit_order_create_evaluator does before it calls apply_order() */
+      const limit_order_object& create_order( account_id_type seller, const asset& sell, const asset& receive,
+                                              time_point_sec expiration )
+      {
+         if( sell.asset_id == asset_id_type() )
+            _db.modify( seller( _db ).statistics( _db ), [&sell]( account_statistics_object& s ) {
+               s.total_core_in_orders += sell.amount;
+            } );
+         _db.adjust_balance( seller, -sell );
+         return _db.create<limit_order_object>( [&]( limit_order_object& o ) {
+            o.seller = seller;
+            o.for_sale = sell.amount;
+            o.sell_price = price( sell, receive );
+            o.expiration = expiration;
+         } );
+      }
+
+      void publish_feed( const asset_object& mia, const price& settlement_price )
+      {
+         price_feed feed;
+         feed.settlement_price = settlement_price;
+         feed.core_exchange_rate = settlement_price;
+         feed.maintenance_collateral_ratio = GRAPHENE_DEFAULT_MAINTENANCE_COLLATERAL_RATIO;
+         feed.maximum_short_squeeze_ratio = GRAPHENE_DEFAULT_MAX_SHORT_SQUEEZE_RATIO;
+         const auto& dgp = _db.get_dynamic_global_properties();
+         _db.modify( mia.bitasset_data( _db ), [&]( asset_bitasset_data_object& b ) {
+            b.feeds.get_mutable()[ GRAPHENE_COMMITTEE_ACCOUNT ] = std::make_pair( dgp.time, feed );
+            b.update_median_feeds( dgp.time, dgp.next_maintenance_time );
+         } );
+      }
+
+      /** Runs one round of a workload, in an undo session that is committed like a block if undo is enabled */
+      template<typename Round>
+      void run_round( Round&& round )
+      {
+         if( !_config.undo )
+         {
+            round();
+            return;
+         }
+         auto session = _db._undo_db.start_undo_session();
+         round();
+         session.commit();
+      }
+
+      const limit_order_book_index& order_book()const
+      {
+         return _db.get_index_type< primary_index< limit_order_index, hashed_ids > >()
+                   .get_secondary_index< limit_order_book_index >();
+      }
+
+      const asset_object& random_market()
+      {
+         return _markets[ std::uniform_int_distribution<size_t>( 0, _markets.size() - 1 )( _rng ) ]( _db );
+      }
+
+      account_id_type random_trader()
+      {
+         return _traders[ std::uniform_int_distribution<size_t>( 0, _traders.size() - 1 )( _rng ) ];
+      }
+
+      share_type random_amount( int64_t min, int64_t max )
+      {
+         return std::uniform_int_distribution<int64_t>( min, max )( _rng );
+      }
+
+      double random_real( double min, double max )
+      {
+         return std::uniform_real_distribution<double>( min, max )( _rng );
+      }
+
+      time_point_sec random_expiration()
+      {
+         return _start + std::uniform_int_distribution<uint32_t>( 60, simulated_seconds )( _rng );
+      }
+
+      static asset scaled( share_type amount, double factor, asset_id_type asset_id )
+      {
+         return asset( std::max<int64_t>( 1, int64_t( amount.value * factor ) ), asset_id );
+      }
+
+      database&                      _db;
+      benchmark_config               _config;
+      std::mt19937_64                _rng;
+      std::vector<account_id_type>   _traders;
+      std::vector<asset_id_type>     _markets;
+      time_point_sec                 _start;
+};
+
+} // anonymous namespace
+
+int main( int argc, char** argv )
+{ try {
+   benchmark_config config;
+   namespace bpo = boost::program_options;
+   bpo::options_description cli_options( "Graphene market engine benchmark" );
+   cli_options.add_options()
+      ("help,h", "Print this help message and exit.")
+      ("accounts", bpo::value<uint32_t>( &config.accounts )->default_value( config.accounts ),
+       "Number of trading accounts")
+      ("markets", bpo::value<uint32_t>( &config.markets )->default_value( config.markets ),
+       "Number of markets, each trades a market pegged asset against the core asset")
+      ("limit-orders", bpo::value<uint32_t>( &config.limit_orders )->default_value( config.limit_orders ),
+       "Limit orders per market, half of them on each side")
+      ("call-orders", bpo::value<uint32_t>( &config.call_orders )->default_value( config.call_orders ),
+       "Call orders per market, at most the number of accounts")
+      ("settle-orders", bpo::value<uint32_t>( &config.settle_orders )->default_value( config.settle_orders ),
+       "Force settlements per market")
+      ("rounds", bpo::value<uint32_t>( &config.rounds )->default_value( config.rounds ),
+       "Calls of the measured function per workload")
+      ("seed", bpo::value<uint64_t>( &config.seed )->default_value( config.seed ),
+       "Seed of the random market shapes and workloads")
+      ("undo", bpo::bool_switch( &config.undo ),
+       "Run every round in an undo session, as when applying blocks, instead of without undo as when replaying")
+      ;
+
+   bpo::variables_map options;
+   try
+   {
+      bpo::store( bpo::parse_command_line( argc, argv, cli_options ), options );
+      bpo::notify( options );
+   }
+   catch( const bpo::error& e )
+   {
+      std::cerr << "market_engine_benchmark:  error parsing command line: " << e.what() << "\n";
+      return 1;
+   }
+
+   if( options.count( "help" ) )
+   {
+      std::cout << cli_options << "\n";
+      return 0;
+   }
+
+   FC_ASSERT( config.accounts > 0 && config.markets > 0 && config.rounds > 0 );
+   FC_ASSERT( config.call_orders <= config.accounts, "An account can have only one call order per market" );
+
+   fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+   database db;
+   db.open( data_dir.path(), [&config]() { return make_genesis( config.accounts ); }, "market_engine_benchmark" );
+
+   market_engine_benchmark benchmark( db, config );
+   const auto setup_start = std::chrono::steady_clock::now();
+   benchmark.build_markets();
+   std::cout << "Built " << config.markets << " markets with " << config.limit_orders << " limit orders, "
+             << config.call_orders << " call orders and " << config.settle_orders << " force settlements each in "
+             << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - setup_start ).count() << " ms\n\n";
+
+   latency_histogram::print_header();
+   benchmark.run_apply_order();
+   benchmark.run_match();
+   benchmark.run_fill_limit_order();
+   benchmark.run_check_call_orders();
+   benchmark.run_clear_expired_orders();
+   return 0;
+} catch( const fc::exception& e ) {
+   std::cerr << "market_engine_benchmark:  " << e.to_detail_string() << "\n";
+   return 1;
+} }
@@ -24,6 +24,7 @@
 #include <boost/endian/conversion.hpp>
 #include <graphene/protocol/block.hpp>
 #include <graphene/protocol/fee_schedule.hpp>
+#include <graphene/protocol/public_key_cache.hpp>
 #include <fc/io/raw.hpp>
 #include <algorithm>
 
@@ -53,7 +54,7 @@ namespace graphene { namespace protocol {
    const fc::ecc::public_key& signed_block_header::signee()const
    {
       if( !_signee.valid() )
-         _signee = fc::ecc::public_key( witness_signature, digest(), true/*enforce canonical*/ );
+         _signee = public_key_cache::recover( witness_signature, digest() ); // enforces canonical signatures
       return _signee;
    }
 
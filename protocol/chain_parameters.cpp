@@ -8,10 +8,10 @@ namespace graphene { namespace protocol {
        current_fees = std::make_shared<fee_schedule>();
    }
 
-   // copy constructor
+   // copy constructor, the fee schedule is shared until one of the copies modifies it
    chain_parameters::chain_parameters(const chain_parameters& other)
    {
-      current_fees = std::make_shared<fee_schedule>(*other.current_fees);
+      current_fees = other.current_fees;
       safe_copy(*this, other);
    }
 
@@ -20,12 +20,20 @@ namespace graphene { namespace protocol {
    {
       if (&other != this)
       {
-         current_fees = std::make_shared<fee_schedule>(*other.current_fees);
+         current_fees = other.current_fees;
          safe_copy(*this, other);
       }
       return *this;
    }
 
+   fee_schedule& chain_parameters::get_mutable_fees()
+   {
+      FC_ASSERT(current_fees);
+      if( current_fees.use_count() > 1 )
+         current_fees = std::make_shared<fee_schedule>(*current_fees);
+      return const_cast<fee_schedule&>(*current_fees);
+   }
+
    // copies the easy stuff
    void chain_parameters::safe_copy(chain_parameters& to, const chain_parameters& from)
    {
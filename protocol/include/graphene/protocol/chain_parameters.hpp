@@ -37,10 +37,13 @@ namespace graphene { namespace protocol {
 
    struct chain_parameters
    {
-      /** using a shared_ptr breaks the circular dependency created between operations and the fee schedule */
+      /**
+       * using a shared_ptr breaks the circular dependency created between operations and the fee schedule,
+       * copies of the parameters share the schedule until get_mutable_fees() is called on one of them
+       */
       std::shared_ptr<const fee_schedule> current_fees;                  ///< current schedule of fees
       const fee_schedule& get_current_fees() const { FC_ASSERT(current_fees); return *current_fees; }
-      fee_schedule& get_mutable_fees() { FC_ASSERT(current_fees); return const_cast<fee_schedule&>(*current_fees); }
+      fee_schedule& get_mutable_fees();
 
       uint8_t                 block_interval                      = GRAPHENE_DEFAULT_BLOCK_INTERVAL; ///< interval in seconds between blocks
       uint32_t                maintenance_interval                = GRAPHENE_DEFAULT_MAINTENANCE_INTERVAL; ///< interval in sections between blockchain maintenance events
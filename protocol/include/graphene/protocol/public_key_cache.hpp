@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/protocol/types.hpp>
+
+namespace graphene { namespace protocol {
+
+   /**
+    * @brief A process wide LRU cache of the public keys recovered from signatures
+    *
+    * Recovering the public key from a compact signature is the most expensive part of checking a transaction,
+    * and the same signature is usually recovered several times: when the transaction arrives on its own, when
+    * it arrives again inside a block, and when blocks are reapplied after a fork switch. Recovered keys are
+    * therefore memoized by (digest, signature). The cache is split into shards with a lock each, so that the
+    * parallel precompute workers do not contend.
+    *
+    * On top of that the complete key set of a transaction is memoized by its signature digest and signatures,
+    * so that a transaction seen in the mempool is not checked signature by signature again when it arrives in
+    * a block.
+    */
+   class public_key_cache
+   {
+      public:
+         /** @return the key that created sig over digest, taken from the cache or recovered and cached */
+         static public_key_type recover( const signature_type& sig, const digest_type& digest );
+
+         /**
+          * Looks up the keys a transaction was signed with
+          * @return true and fills keys if the transaction is cached
+          */
+         static bool find_transaction_keys( const digest_type& sig_digest, const vector<signature_type>& signatures,
+                                            flat_set<public_key_type>& keys );
+         /** Caches the keys of a transaction whose signatures were all recovered without duplicates */
+         static void store_transaction_keys( const digest_type& sig_digest, const vector<signature_type>& signatures,
+                                             const flat_set<public_key_type>& keys );
+
+         /** Sets the maximum number of cached keys, 0 disables the cache */
+         static void   set_capacity( size_t entries );
+         static size_t get_capacity();
+
+         /** Sets the maximum number of cached transaction key sets, 0 disables the cache */
+         static void   set_transaction_capacity( size_t entries );
+         static size_t get_transaction_capacity();
+   };
+
+} } // graphene::protocol
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/protocol/public_key_cache.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace protocol {
+
+namespace {
+
+   struct cache_key
+   {
+      digest_type    digest;
+      signature_type signature;
+
+      friend bool operator==( const cache_key& a, const cache_key& b )
+      {
+         return a.digest == b.digest && a.signature == b.signature;
+      }
+   };
+
+   struct cache_key_hash
+   {
+      size_t operator()( const cache_key& k )const
+      {
+         // both are hash outputs already, mix the signature in for transactions with several signatures
+         size_t digest_bits;
+         size_t signature_bits;
+         std::memcpy( &digest_bits, k.digest.data(), sizeof(digest_bits) );
+         std::memcpy( &signature_bits, k.signature.begin() + 1, sizeof(signature_bits) );
+         return digest_bits ^ signature_bits;
+      }
+   };
+
+   struct digest_hash
+   {
+      size_t operator()( const digest_type& d )const
+      {
+         size_t bits;
+         std::memcpy( &bits, d.data(), sizeof(bits) );
+         return bits;
+      }
+   };
+
+   /// An LRU map split into shards with a lock each
+   template< typename Key, typename Value, typename Hash >
+   class sharded_lru
+   {
+      public:
+         explicit sharded_lru( size_t entries ) : _capacity( entries ) {}
+
+         bool enabled()const { return _capacity.load( std::memory_order_relaxed ) > 0; }
+
+         bool find( const Key& key, Value& value )
+         {
+            shard& s = shard_of( key );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            auto itr = s.entries.find( key );
+            if( itr == s.entries.end() )
+               return false;
+            s.lru.splice( s.lru.begin(), s.lru, itr->second );
+            value = itr->second->second;
+            return true;
+         }
+
+         void store( const Key& key, const Value& value )
+         {
+            const size_t max_entries = ( _capacity.load( std::memory_order_relaxed ) + shard_count - 1 ) / shard_count;
+            if( max_entries == 0 )
+               return;
+            shard& s = shard_of( key );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            // a concurrent store of the same key just finds the entry present
+            if( s.entries.find( key ) == s.entries.end() )
+            {
+               s.lru.emplace_front( key, value );
+               s.entries.emplace( key, s.lru.begin() );
+            }
+            while( s.lru.size() > max_entries )
+            {
+               s.entries.erase( s.lru.back().first );
+               s.lru.pop_back();
+            }
+         }
+
+         void set_capacity( size_t entries )
+         {
+            _capacity.store( entries, std::memory_order_relaxed );
+            if( entries > 0 ) return;
+            for( auto& s : _shards )
+            {
+               std::lock_guard<std::mutex> lock( s.mutex );
+               s.entries.clear();
+               s.lru.clear();
+            }
+         }
+
+         size_t get_capacity()const { return _capacity.load( std::memory_order_relaxed ); }
+
+      private:
+         typedef std::list< std::pair<Key, Value> > lru_list;
+
+         struct shard
+         {
+            std::mutex                                         mutex;
+            lru_list                                           lru;
+            std::unordered_map< Key, typename lru_list::iterator, Hash > entries;
+         };
+
+         static const size_t shard_count = 16;
+
+         shard& shard_of( const Key& key ) { return _shards[ ( Hash()( key ) >> 8 ) % shard_count ]; }
+
+         shard               _shards[shard_count];
+         std::atomic<size_t> _capacity;
+   };
+
+   sharded_lru< cache_key, public_key_type, cache_key_hash >                key_cache( 200000 );
+   sharded_lru< digest_type, flat_set<public_key_type>, digest_hash >      transaction_cache( 50000 );
+
+   digest_type transaction_key( const digest_type& sig_digest, const vector<signature_type>& signatures )
+   {
+      digest_type::encoder enc;
+      enc.write( sig_digest.data(), sig_digest.data_size() );
+      for( const auto& sig : signatures )
+         enc.write( (const char*)sig.begin(), sizeof(sig) );
+      return enc.result();
+   }
+
+}
+
+public_key_type public_key_cache::recover( const signature_type& sig, const digest_type& digest )
+{
+   if( !key_cache.enabled() )
+      return fc::ecc::public_key( sig, digest );
+
+   const cache_key key{ digest, sig };
+   public_key_type result;
+   if( key_cache.find( key, result ) )
+      return result;
+
+   // recover outside of the lock
+   result = fc::ecc::public_key( sig, digest );
+   key_cache.store( key, result );
+   return result;
+}
+
+bool public_key_cache::find_transaction_keys( const digest_type& sig_digest, const vector<signature_type>& signatures,
+                                              flat_set<public_key_type>& keys )
+{
+   if( signatures.empty() || !transaction_cache.enabled() )
+      return false;
+   return transaction_cache.find( transaction_key( sig_digest, signatures ), keys );
+}
+
+void public_key_cache::store_transaction_keys( const digest_type& sig_digest, const vector<signature_type>& signatures,
+                                               const flat_set<public_key_type>& keys )
+{
+   if( signatures.empty() || !transaction_cache.enabled() )
+      return;
+   transaction_cache.store( transaction_key( sig_digest, signatures ), keys );
+}
+
+void public_key_cache::set_capacity( size_t entries )
+{
+   key_cache.set_capacity( entries );
+}
+
+size_t public_key_cache::get_capacity()
+{
+   return key_cache.get_capacity();
+}
+
+void public_key_cache::set_transaction_capacity( size_t entries )
+{
+   transaction_cache.set_capacity( entries );
+}
+
+size_t public_key_cache::get_transaction_capacity()
+{
+   return transaction_cache.get_capacity();
+}
+
+} } // graphene::protocol
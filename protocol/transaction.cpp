@@ -27,6 +27,7 @@
 #include <graphene/protocol/exceptions.hpp>
 #include <graphene/protocol/fee_schedule.hpp>
 #include <graphene/protocol/pts_address.hpp>
+#include <graphene/protocol/public_key_cache.hpp>
 
 #include <fc/io/raw.hpp>
 
@@ -323,13 +324,19 @@ const flat_set<public_key_type>& signed_transaction::get_signature_keys( const c
 { try {
    auto d = sig_digest( chain_id );
    flat_set<public_key_type> result;
+   if( public_key_cache::find_transaction_keys( d, signatures, result ) )
+   {
+      _signees = std::move( result );
+      return _signees;
+   }
    for( const auto&  sig : signatures )
    {
       GRAPHENE_ASSERT(
-         result.insert( fc::ecc::public_key(sig,d) ).second,
+         result.insert( public_key_cache::recover( sig, d ) ).second,
             tx_duplicate_sig,
             "Duplicate Signature detected" );
    }
+   public_key_cache::store_transaction_keys( d, signatures, result );
    _signees = std::move( result );
    return _signees;
 } FC_CAPTURE_AND_RETHROW() }
@@ -105,11 +105,13 @@ namespace fc
     
     void from_variant( const fc::variant& var, std::shared_ptr<const graphene::protocol::fee_schedule>& vo,
                        uint32_t max_depth ) {
-        // If it's null, just make a new one
-        if (!vo) vo = std::make_shared<const graphene::protocol::fee_schedule>();
-        // Convert the non-const shared_ptr<const fee_schedule> to a non-const fee_schedule& so we can write it
+        // The schedule may be shared with copies of the chain parameters, so always write into a new one,
+        // starting from the current contents if there are any
+        auto fees = vo ? std::make_shared<graphene::protocol::fee_schedule>(*vo)
+                       : std::make_shared<graphene::protocol::fee_schedule>();
         // Don't decrement max_depth since we're not actually deserializing at this step
-        from_variant(var, const_cast<graphene::protocol::fee_schedule&>(*vo), max_depth);
+        from_variant(var, *fees, max_depth);
+        vo = std::move(fees);
     }
 
 namespace raw {